@@ -1,59 +1,175 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <span>
+#include <thread>
 
 #include "ExprInPolishNotation.hpp"
+#include "JitProgram.hpp"
 #include "OperandToken.hpp"
 #include "OperatorToken.hpp"
+#include "Optimizer.hpp"
+#include "Program.hpp"
+#include "ProgramCache.hpp"
+#include "WorkerPool.hpp"
+
+template <typename T>
+struct CalculationResult {
+  T value = T();
+  bool valid = false;
+};
 
 template <typename T>
 class Calculator {
  public:
   static T CalculateExpr(const std::string& expr);
 
+  static T CalculateExpr(const std::string& expr, ProgramCache<T>& cache);
+
+  static Program<T> Compile(const std::string& expr,
+                            const std::vector<std::string>& variables = {});
+
+  static JitProgram<T> CompileNative(
+      const std::string& expr, const std::vector<std::string>& variables = {});
+
   static void CalculateTokens(std::deque<AbstractToken*>& tokens);
+
+  static std::vector<CalculationResult<T>> CalculateBatch(
+      std::span<const std::string> exprs, size_t thread_count = 0);
 };
 
+namespace batch {
+const size_t kChunkSize = 256;
+}  // namespace batch
+
 template <typename T>
 T Calculator<T>::CalculateExpr(const std::string& expr) {
-  auto tokens = ExprInPolishNotation<T>(expr).GetTokens();
-  auto deque = std::deque<AbstractToken*>(tokens.begin(), tokens.end());
-  CalculateTokens(deque);
-  if (deque.size() != 1) {
-    while (!deque.empty()) {
-      delete deque.front();
-      deque.pop_front();
+  return Program<T>(ExprInPolishNotation<T>(expr)).Evaluate();
+}
+
+template <typename T>
+T Calculator<T>::CalculateExpr(const std::string& expr,
+                               ProgramCache<T>& cache) {
+  return cache.Get(expr)->Evaluate();
+}
+
+template <typename T>
+Program<T> Calculator<T>::Compile(const std::string& expr,
+                                  const std::vector<std::string>& variables) {
+  return Optimizer<T>::Optimize(ExprInPolishNotation<T>(expr), variables);
+}
+
+// Evaluates the operation at the front of tokens and replaces it together
+// with its operands by the result. Pending operators are kept on an explicit
+// stack, so nesting depth is limited only by memory.
+template <typename T>
+void Calculator<T>::CalculateTokens(std::deque<AbstractToken*>& tokens) {
+  struct PendingOperation {
+    AbstractToken* operation;
+    bool binary;
+    OperandToken<T>* first = nullptr;
+  };
+  std::vector<PendingOperation> pending;
+
+  auto fail = [&pending]() {
+    for (PendingOperation& operation : pending) {
+      delete operation.first;
+      delete operation.operation;
     }
     throw InvalidExpr();
+  };
+
+  while (true) {
+    if (tokens.empty()) {
+      fail();
+    }
+    AbstractToken* now = tokens.front();
+    if (dynamic_cast<OperatorToken<T, true>*>(now) != nullptr) {
+      tokens.pop_front();
+      pending.push_back({now, true});
+      continue;
+    }
+    if (dynamic_cast<OperatorToken<T, false>*>(now) != nullptr) {
+      tokens.pop_front();
+      pending.push_back({now, false});
+      continue;
+    }
+    if (pending.empty()) {
+      return;
+    }
+    auto* result = dynamic_cast<OperandToken<T>*>(now);
+    if (result == nullptr) {
+      fail();
+    }
+    tokens.pop_front();
+
+    while (!pending.empty()) {
+      PendingOperation& top = pending.back();
+      if (top.binary && top.first == nullptr) {
+        top.first = result;
+        result = nullptr;
+        break;
+      }
+      OperandToken<T>* value;
+      if (top.binary) {
+        value = static_cast<OperatorToken<T, true>*>(top.operation)
+                    ->Calculate(top.first, result);
+        delete top.first;
+      } else {
+        value = static_cast<OperatorToken<T, false>*>(top.operation)
+                    ->Calculate(result);
+      }
+      delete result;
+      delete top.operation;
+      pending.pop_back();
+      result = value;
+    }
+    if (result != nullptr) {
+      tokens.push_front(result);
+      return;
+    }
   }
-  T value = dynamic_cast<OperandToken<T>*>(deque.front())->GetValue();
-  delete deque.front();
-  return value;
 }
 
 template <typename T>
-void Calculator<T>::CalculateTokens(std::deque<AbstractToken*>& tokens) {
-  AbstractToken* now = tokens.front();
+JitProgram<T> Calculator<T>::CompileNative(
+    const std::string& expr, const std::vector<std::string>& variables) {
+  return JitProgram<T>(Compile(expr, variables));
+}
 
-  if (dynamic_cast<OperatorToken<T, true>*>(now) != nullptr) {
-    tokens.pop_front();
-    auto operation = dynamic_cast<OperatorToken<T, true>*>(now);
-    CalculateTokens(tokens);
-    OperandToken<T>* first = dynamic_cast<OperandToken<T>*>(tokens.front());
-    tokens.pop_front();
-    CalculateTokens(tokens);
-    OperandToken<T>* second = dynamic_cast<OperandToken<T>*>(tokens.front());
-    tokens.pop_front();
-    tokens.push_front(operation->Calculate(first, second));
-    delete first;
-    delete second;
-    delete operation;
-  } else if (dynamic_cast<OperatorToken<T, false>*>(now) != nullptr) {
-    tokens.pop_front();
-    auto operation = dynamic_cast<OperatorToken<T, false>*>(now);
-    CalculateTokens(tokens);
-    OperandToken<T>* element = dynamic_cast<OperandToken<T>*>(tokens.front());
-    tokens.pop_front();
-    tokens.push_front(operation->Calculate(element));
-    delete element;
-    delete operation;
+// Invalid expressions and undefined integer divisions are reported through
+// CalculationResult::valid instead of exceptions. The calling thread and
+// helpers from WorkerPool take chunks of expressions from a shared counter
+// and reuse their own parser and program buffers for every item.
+template <typename T>
+std::vector<CalculationResult<T>> Calculator<T>::CalculateBatch(
+    std::span<const std::string> exprs, size_t thread_count) {
+  std::vector<CalculationResult<T>> results(exprs.size());
+  if (thread_count == 0) {
+    thread_count = std::max(1U, std::thread::hardware_concurrency());
   }
+  size_t chunk_count =
+      (exprs.size() + batch::kChunkSize - 1) / batch::kChunkSize;
+  thread_count = std::max<size_t>(std::min(thread_count, chunk_count), 1);
+
+  std::atomic<size_t> next_chunk = 0;
+  std::function<void()> worker = [&]() {
+    ExprInPolishNotation<T> parser;
+    Program<T> program;
+    for (size_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+         chunk < chunk_count;
+         chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) {
+      size_t end = std::min(exprs.size(), (chunk + 1) * batch::kChunkSize);
+      for (size_t idx = chunk * batch::kChunkSize; idx < end; ++idx) {
+        CalculationResult<T>& result = results[idx];
+        result.valid = parser.TryParse(exprs[idx]) &&
+                       program.TryCompile(parser) &&
+                       program.TryEvaluate({}, result.value);
+      }
+    }
+  };
+  WorkerPool::Instance().Run(worker, thread_count - 1);
+  return results;
 }
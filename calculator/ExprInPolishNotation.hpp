@@ -1,8 +1,11 @@
 #pragma once
-#include <deque>
-#include <list>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include "AbstractToken.hpp"
@@ -10,149 +13,261 @@
 #include "InvalidExpr.hpp"
 #include "OperandToken.hpp"
 #include "OperatorToken.hpp"
+#include "Token.hpp"
+#include "VariableToken.hpp"
 
 namespace tokens {
-const std::unordered_map<std::string, int> kPriorities{
-    {"+", 1}, {"-", 1}, {"*", 2}, {"/", 2}, {"(", -1}, {")", -2},
+enum class CharClass : uint8_t {
+  kInvalid,
+  kSpace,
+  kLiteral,
+  kOperator,
+  kOpeningBracket,
+  kClosingBracket,
 };
-}
 
-int GetPriority(const std::string& token) {
-  int priority = 0;
-  if (tokens::kPriorities.contains(token)) {
-    priority = tokens::kPriorities.at(token);
+constexpr std::array<CharClass, 256> MakeCharClasses() {
+  std::array<CharClass, 256> classes{};
+  for (int symbol = 0; symbol < 256; ++symbol) {
+    bool literal = (symbol >= '0' && symbol <= '9') ||
+                   (symbol >= 'a' && symbol <= 'z') ||
+                   (symbol >= 'A' && symbol <= 'Z') || symbol == '_' ||
+                   symbol == '.';
+    classes[symbol] = literal ? CharClass::kLiteral : CharClass::kInvalid;
+  }
+  for (char symbol : {' ', '\t', '\n', '\r', '\v', '\f'}) {
+    classes[symbol] = CharClass::kSpace;
+  }
+  for (char symbol : {'+', '-', '*', '/'}) {
+    classes[symbol] = CharClass::kOperator;
   }
-  return priority;
+  classes['('] = CharClass::kOpeningBracket;
+  classes[')'] = CharClass::kClosingBracket;
+  return classes;
+}
+
+constexpr std::array<int, 256> MakePriorities() {
+  std::array<int, 256> priorities{};
+  priorities['+'] = 1;
+  priorities['-'] = 1;
+  priorities['*'] = 2;
+  priorities['/'] = 2;
+  priorities['('] = -1;
+  priorities[')'] = -2;
+  return priorities;
+}
+
+inline constexpr std::array<CharClass, 256> kCharClasses = MakeCharClasses();
+
+inline constexpr std::array<int, 256> kPriorities = MakePriorities();
+
+const int kUnaryPriority = 3;
+
+inline CharClass GetCharClass(char symbol) {
+  return kCharClasses[static_cast<unsigned char>(symbol)];
+}
+}  // namespace tokens
+
+inline int GetPriority(char token) {
+  return tokens::kPriorities[static_cast<unsigned char>(token)];
 }
 
+inline int GetPriority(const std::string& token) {
+  return token.size() == 1 ? GetPriority(token[0]) : 0;
+}
+
+// Shunting-yard over the expression read from right to left; reversing the
+// output gives Polish notation. Tokens are kept by value in one vector;
+// GetTokens builds the AbstractToken objects only when asked for them.
+// TryParse reports errors without throwing and reuses the buffers of the
+// previous parse.
 template <typename T>
 class ExprInPolishNotation {
  public:
-  ExprInPolishNotation(const std::string& tokens_string);
+  ExprInPolishNotation() = default;
+
+  ExprInPolishNotation(std::string_view tokens_string);
+
+  bool TryParse(std::string_view tokens_string);
+
+  const std::vector<AbstractToken*>& GetTokens();
+
+  const std::vector<Token<T>>& GetCompactTokens() const {
+    return compact_tokens_;
+  }
 
-  const std::vector<AbstractToken*>& GetTokens() { return tokens_; };
+  std::string_view GetText(const Token<T>& token) const {
+    return std::string_view(expr_).substr(token.text_offset, token.text_size);
+  }
 
  private:
-  void RemoveSpaces(std::list<char>& tokens);
+  bool PushLiteral(size_t offset, size_t size);
 
-  void PushNumber(std::string& number_string);
+  void PushOperation(std::pair<char, int> operation);
 
-  void PostProcess(std::deque<AbstractToken*>& waiting_operations);
+  bool PostProcess();
 
-  void ProcessOperator(std::list<char>::iterator iter, std::string& now,
-                       int priority,
-                       std::deque<AbstractToken*>& waiting_operations);
+  void ProcessOperator(char operation, bool unary);
 
-  void ProcessBracket(std::string& now, int priority,
-                      std::deque<AbstractToken*>& waiting_operations);
+  bool ProcessBracket(char bracket);
 
+  std::string expr_;
+  std::vector<Token<T>> compact_tokens_;
+  std::vector<std::pair<char, int>> waiting_operations_;
   std::vector<AbstractToken*> tokens_;
 };
-template <typename T>
-void ExprInPolishNotation<T>::PostProcess(
-    std::deque<AbstractToken*>& waiting_operations) {
-  while (!waiting_operations.empty()) {
-    tokens_.push_back(waiting_operations.back());
-    waiting_operations.pop_back();
-  }
 
-  std::reverse(tokens_.begin(), tokens_.end());
-}
 template <typename T>
-void ExprInPolishNotation<T>::PushNumber(std::string& number_string) {
-  if (!number_string.empty()) {
-    std::reverse(number_string.begin(), number_string.end());
-    tokens_.push_back(new OperandToken<T>(number_string));
-    number_string.clear();
+const std::vector<AbstractToken*>& ExprInPolishNotation<T>::GetTokens() {
+  if (tokens_.empty()) {
+    tokens_.reserve(compact_tokens_.size());
+    for (const Token<T>& token : compact_tokens_) {
+      std::string text(1, token.operation);
+      switch (token.kind) {
+        case TokenKind::kOperand:
+          tokens_.push_back(new OperandToken<T>(std::string(GetText(token))));
+          break;
+        case TokenKind::kVariable:
+          tokens_.push_back(new VariableToken(std::string(GetText(token))));
+          break;
+        case TokenKind::kBinaryOperator:
+          tokens_.push_back(new OperatorToken<T, true>(text));
+          break;
+        case TokenKind::kUnaryOperator:
+          tokens_.push_back(new OperatorToken<T, false>(text));
+          break;
+      }
+    }
   }
+  return tokens_;
 }
+
 template <typename T>
-void ExprInPolishNotation<T>::ProcessBracket(
-    std::string& now, int priority,
-    std::deque<AbstractToken*>& waiting_operations) {
-  if (priority == -2) {
-    // Opening bracket
-    waiting_operations.push_back(new BracketToken(now));
-  } else {
-    // Closing bracket
-    while (!waiting_operations.empty() &&
-           waiting_operations.back()->GetStringToken() != ")") {
-      tokens_.push_back(waiting_operations.back());
-      waiting_operations.pop_back();
-    }
-    if (waiting_operations.empty()) {
-      while (!waiting_operations.empty()) {
-        delete waiting_operations.front();
-        waiting_operations.pop_front();
-      }
-      while (!tokens_.empty()) {
-        delete tokens_.back();
-        tokens_.pop_back();
-      }
-      throw InvalidExpr();
+bool ExprInPolishNotation<T>::PostProcess() {
+  while (!waiting_operations_.empty()) {
+    if (waiting_operations_.back().second < 0) {
+      return false;
     }
-    delete waiting_operations.back();
-    waiting_operations.pop_back();
+    PushOperation(waiting_operations_.back());
+    waiting_operations_.pop_back();
   }
+
+  std::reverse(compact_tokens_.begin(), compact_tokens_.end());
+  return true;
 }
+
 template <typename T>
-void ExprInPolishNotation<T>::ProcessOperator(
-    std::list<char>::iterator iter, std::string& now, int priority,
-    std::deque<AbstractToken*>& waiting_operations) {
-  AbstractToken* operation;
-  if (GetPriority(std::string(1, *++iter)) > 0 ||
-      GetPriority(std::string(1, *iter)) == -1) {
-    operation = new OperatorToken<T, false>(now);
-    priority += 2;
-  } else {
-    operation = new OperatorToken<T, true>(now);
+bool ExprInPolishNotation<T>::PushLiteral(size_t offset, size_t size) {
+  Token<T> token{TokenKind::kOperand};
+  token.text_offset = static_cast<uint32_t>(offset);
+  token.text_size = static_cast<uint32_t>(size);
+  char front = expr_[offset];
+  if (std::isalpha(static_cast<unsigned char>(front)) != 0 || front == '_') {
+    token.kind = TokenKind::kVariable;
+  } else if (!TryParseOperand(GetText(token), token.value)) {
+    return false;
   }
+  compact_tokens_.push_back(token);
+  return true;
+}
+
+template <typename T>
+void ExprInPolishNotation<T>::PushOperation(std::pair<char, int> operation) {
+  compact_tokens_.push_back({operation.second == tokens::kUnaryPriority
+                                 ? TokenKind::kUnaryOperator
+                                 : TokenKind::kBinaryOperator,
+                             operation.first});
+}
 
-  while (
-      !waiting_operations.empty() &&
-      ((dynamic_cast<OperatorToken<T, false>*>(waiting_operations.back())) ||
-       (GetPriority(waiting_operations.back()->GetStringToken()) > priority))) {
-    tokens_.push_back(waiting_operations.back());
-    waiting_operations.pop_back();
+template <typename T>
+bool ExprInPolishNotation<T>::ProcessBracket(char bracket) {
+  if (bracket == ')') {
+    // Opening bracket
+    waiting_operations_.emplace_back(bracket, GetPriority(bracket));
+    return true;
+  }
+  // Closing bracket
+  while (!waiting_operations_.empty() &&
+         waiting_operations_.back().second != GetPriority(')')) {
+    PushOperation(waiting_operations_.back());
+    waiting_operations_.pop_back();
   }
-  waiting_operations.push_back(operation);
+  if (waiting_operations_.empty()) {
+    return false;
+  }
+  waiting_operations_.pop_back();
+  return true;
 }
 
 template <typename T>
-void ExprInPolishNotation<T>::RemoveSpaces(std::list<char>& tokens) {
-  for (auto token_it = tokens.begin(); token_it != tokens.end(); ++token_it) {
-    if ((*token_it) == ' ') {
-      token_it = --tokens.erase(token_it);
-    }
+void ExprInPolishNotation<T>::ProcessOperator(char operation, bool unary) {
+  int priority = unary ? tokens::kUnaryPriority : GetPriority(operation);
+  while (!waiting_operations_.empty() &&
+         (waiting_operations_.back().second == tokens::kUnaryPriority ||
+          waiting_operations_.back().second > priority)) {
+    PushOperation(waiting_operations_.back());
+    waiting_operations_.pop_back();
   }
+  waiting_operations_.emplace_back(operation, priority);
 }
 
 template <typename T>
-ExprInPolishNotation<T>::ExprInPolishNotation(
-    const std::string& tokens_string) {
-  std::string number_string;
-  std::list<char> tokens(tokens_string.begin(), tokens_string.end());
-  std::reverse(tokens.begin(), tokens.end());
-  std::deque<AbstractToken*> waiting_operations;
-
-  RemoveSpaces(tokens);
-
-  for (auto token_it = tokens.begin(); token_it != tokens.end(); ++token_it) {
-    std::string now(1, *token_it);
-    int priority = GetPriority(now);
-
-    if (priority == 0) {
-      number_string += now;
-      continue;
-    }
-    PushNumber(number_string);
+ExprInPolishNotation<T>::ExprInPolishNotation(std::string_view tokens_string) {
+  if (!TryParse(tokens_string)) {
+    throw InvalidExpr();
+  }
+}
 
-    if (priority > 0) {
-      ProcessOperator(token_it, now, priority, waiting_operations);
-    } else {
-      ProcessBracket(now, priority, waiting_operations);
+template <typename T>
+bool ExprInPolishNotation<T>::TryParse(std::string_view tokens_string) {
+  expr_.assign(tokens_string);
+  compact_tokens_.clear();
+  waiting_operations_.clear();
+  tokens_.clear();
+  size_t pos = expr_.size();
+  while (pos > 0) {
+    char symbol = expr_[pos - 1];
+    switch (tokens::GetCharClass(symbol)) {
+      case tokens::CharClass::kSpace:
+        --pos;
+        break;
+      case tokens::CharClass::kLiteral: {
+        size_t end = pos;
+        while (pos > 0 &&
+               tokens::GetCharClass(expr_[pos - 1]) ==
+                   tokens::CharClass::kLiteral) {
+          --pos;
+        }
+        if (!PushLiteral(pos, end - pos)) {
+          return false;
+        }
+        break;
+      }
+      case tokens::CharClass::kOperator: {
+        --pos;
+        size_t previous = pos;
+        while (previous > 0 && tokens::GetCharClass(expr_[previous - 1]) ==
+                                   tokens::CharClass::kSpace) {
+          --previous;
+        }
+        bool unary = previous == 0 ||
+                     tokens::GetCharClass(expr_[previous - 1]) ==
+                         tokens::CharClass::kOperator ||
+                     tokens::GetCharClass(expr_[previous - 1]) ==
+                         tokens::CharClass::kOpeningBracket;
+        ProcessOperator(symbol, unary);
+        break;
+      }
+      case tokens::CharClass::kOpeningBracket:
+      case tokens::CharClass::kClosingBracket:
+        --pos;
+        if (!ProcessBracket(symbol)) {
+          return false;
+        }
+        break;
+      default:
+        return false;
     }
   }
-  PushNumber(number_string);
-  PostProcess(waiting_operations);
+  return PostProcess();
 }
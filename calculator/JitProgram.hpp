@@ -0,0 +1,268 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define CALCULATOR_JIT_AVAILABLE 1
+#else
+#define CALCULATOR_JIT_AVAILABLE 0
+#endif
+
+#include "Program.hpp"
+
+namespace jit {
+template <typename T>
+constexpr bool kIsDouble = std::is_same_v<T, double>;
+
+template <typename T>
+constexpr bool kIsInt64 =
+    std::is_integral_v<T> && std::is_signed_v<T> && sizeof(T) == 8;
+
+// The generated code keeps its operand stack on the native stack, so deeper
+// programs (more than 4 KiB of operands) are left to the interpreter, which
+// moves its stack to the heap.
+const size_t kMaxStackDepth = 512;
+
+class Assembler {
+ public:
+  void Emit(std::initializer_list<uint8_t> bytes) {
+    code_.insert(code_.end(), bytes);
+  }
+
+  void EmitDisplacement(uint32_t index) {
+    uint32_t displacement = index * 8;
+    for (int shift = 0; shift < 32; shift += 8) {
+      code_.push_back(static_cast<uint8_t>(displacement >> shift));
+    }
+  }
+
+  const std::vector<uint8_t>& GetCode() const { return code_; }
+
+ private:
+  std::vector<uint8_t> code_;
+};
+}  // namespace jit
+
+// Program compiled to x86-64 machine code for double and 64-bit signed
+// integers. The native function has the signature
+// T(const T* values, const T* constants, T* temps). When native code can't
+// be produced (other types or platforms, very deep stacks, mmap failure)
+// Evaluate runs the interpreter instead.
+template <typename T>
+class JitProgram {
+ public:
+  explicit JitProgram(Program<T> program);
+
+  JitProgram(const JitProgram& other) = delete;
+
+  JitProgram(JitProgram&& other) noexcept;
+
+  JitProgram& operator=(const JitProgram& other) = delete;
+
+  JitProgram& operator=(JitProgram&& other) noexcept;
+
+  bool IsCompiled() const { return function_ != nullptr; }
+
+  const Program<T>& GetProgram() const { return program_; }
+
+  T Evaluate() const { return Evaluate(std::span<const T>()); }
+
+  T Evaluate(std::span<const T> values) const;
+
+  ~JitProgram();
+
+ private:
+  using Function = T (*)(const T*, const T*, T*);
+
+  static bool Assemble(const Program<T>& program, jit::Assembler& assembler);
+
+  void Release();
+
+  Program<T> program_;
+  void* code_ = nullptr;
+  size_t code_size_ = 0;
+  Function function_ = nullptr;
+};
+
+template <typename T>
+bool JitProgram<T>::Assemble(const Program<T>& program,
+                             jit::Assembler& assembler) {
+  // mov r8, rdx: rdx is clobbered by idiv
+  assembler.Emit({0x49, 0x89, 0xD0});
+  for (const bytecode::Instruction& instruction : program.GetCode()) {
+    switch (instruction.code) {
+      case bytecode::OpCode::kPush:
+        // mov rax, [rsi + disp32]; push rax
+        assembler.Emit({0x48, 0x8B, 0x86});
+        assembler.EmitDisplacement(instruction.index);
+        assembler.Emit({0x50});
+        break;
+      case bytecode::OpCode::kLoad:
+        // mov rax, [rdi + disp32]; push rax
+        assembler.Emit({0x48, 0x8B, 0x87});
+        assembler.EmitDisplacement(instruction.index);
+        assembler.Emit({0x50});
+        break;
+      case bytecode::OpCode::kLoadTemp:
+        // mov rax, [r8 + disp32]; push rax
+        assembler.Emit({0x49, 0x8B, 0x80});
+        assembler.EmitDisplacement(instruction.index);
+        assembler.Emit({0x50});
+        break;
+      case bytecode::OpCode::kStore:
+        // mov rax, [rsp]; mov [r8 + disp32], rax
+        assembler.Emit({0x48, 0x8B, 0x04, 0x24, 0x49, 0x89, 0x80});
+        assembler.EmitDisplacement(instruction.index);
+        break;
+      case bytecode::OpCode::kNegate:
+        if constexpr (jit::kIsDouble<T>) {
+          // btc qword [rsp], 63
+          assembler.Emit({0x48, 0x0F, 0xBA, 0x3C, 0x24, 0x3F});
+        } else {
+          // neg qword [rsp]
+          assembler.Emit({0x48, 0xF7, 0x1C, 0x24});
+        }
+        break;
+      default:
+        if constexpr (jit::kIsDouble<T>) {
+          // movsd xmm0, [rsp]; add rsp, 8; <op>sd xmm0, [rsp];
+          // movsd [rsp], xmm0
+          uint8_t opcode = 0;
+          switch (instruction.code) {
+            case bytecode::OpCode::kAdd:
+              opcode = 0x58;
+              break;
+            case bytecode::OpCode::kSubtract:
+              opcode = 0x5C;
+              break;
+            case bytecode::OpCode::kMultiply:
+              opcode = 0x59;
+              break;
+            case bytecode::OpCode::kDivide:
+              opcode = 0x5E;
+              break;
+            default:
+              return false;
+          }
+          assembler.Emit({0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x08,
+                          0xF2, 0x0F, opcode, 0x04, 0x24, 0xF2, 0x0F, 0x11,
+                          0x04, 0x24});
+        } else {
+          // pop rax; pop rcx; <op> rax, rcx; push rax
+          assembler.Emit({0x58, 0x59});
+          switch (instruction.code) {
+            case bytecode::OpCode::kAdd:
+              assembler.Emit({0x48, 0x01, 0xC8});
+              break;
+            case bytecode::OpCode::kSubtract:
+              assembler.Emit({0x48, 0x29, 0xC8});
+              break;
+            case bytecode::OpCode::kMultiply:
+              assembler.Emit({0x48, 0x0F, 0xAF, 0xC1});
+              break;
+            case bytecode::OpCode::kDivide:
+              // cqo; idiv rcx
+              assembler.Emit({0x48, 0x99, 0x48, 0xF7, 0xF9});
+              break;
+            default:
+              return false;
+          }
+          assembler.Emit({0x50});
+        }
+    }
+  }
+  if constexpr (jit::kIsDouble<T>) {
+    // movsd xmm0, [rsp]; add rsp, 8; ret
+    assembler.Emit({0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x08, 0xC3});
+  } else {
+    // pop rax; ret
+    assembler.Emit({0x58, 0xC3});
+  }
+  return true;
+}
+
+template <typename T>
+JitProgram<T>::JitProgram(Program<T> program) : program_(std::move(program)) {
+#if CALCULATOR_JIT_AVAILABLE
+  if constexpr (jit::kIsDouble<T> || jit::kIsInt64<T>) {
+    jit::Assembler assembler;
+    if (program_.StackDepth() > jit::kMaxStackDepth ||
+        !Assemble(program_, assembler)) {
+      return;
+    }
+    const std::vector<uint8_t>& code = assembler.GetCode();
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+      return;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, code.size());
+      return;
+    }
+    code_ = memory;
+    code_size_ = code.size();
+    function_ = reinterpret_cast<Function>(code_);
+  }
+#endif
+}
+
+template <typename T>
+JitProgram<T>::JitProgram(JitProgram&& other) noexcept
+    : program_(std::move(other.program_)),
+      code_(std::exchange(other.code_, nullptr)),
+      code_size_(std::exchange(other.code_size_, 0)),
+      function_(std::exchange(other.function_, nullptr)) {}
+
+template <typename T>
+JitProgram<T>& JitProgram<T>::operator=(JitProgram&& other) noexcept {
+  if (this != &other) {
+    Release();
+    program_ = std::move(other.program_);
+    code_ = std::exchange(other.code_, nullptr);
+    code_size_ = std::exchange(other.code_size_, 0);
+    function_ = std::exchange(other.function_, nullptr);
+  }
+  return *this;
+}
+
+template <typename T>
+void JitProgram<T>::Release() {
+#if CALCULATOR_JIT_AVAILABLE
+  if (code_ != nullptr) {
+    munmap(code_, code_size_);
+  }
+#endif
+  code_ = nullptr;
+  function_ = nullptr;
+}
+
+template <typename T>
+JitProgram<T>::~JitProgram() {
+  Release();
+}
+
+template <typename T>
+T JitProgram<T>::Evaluate(std::span<const T> values) const {
+  if (function_ == nullptr) {
+    return program_.Evaluate(values);
+  }
+  if (values.size() < program_.VariableCount()) {
+    throw std::out_of_range("Program: not enough variable values");
+  }
+  if (program_.TempCount() <= bytecode::kInlineStackSize) {
+    T temps[bytecode::kInlineStackSize];
+    return function_(values.data(), program_.GetConstants().data(), temps);
+  }
+  std::vector<T> temps(program_.TempCount());
+  return function_(values.data(), program_.GetConstants().data(),
+                   temps.data());
+}
@@ -1,7 +1,40 @@
 #pragma once
+#include <charconv>
 #include <sstream>
+#include <string_view>
+#include <type_traits>
 
 #include "AbstractToken.hpp"
+#include "InvalidExpr.hpp"
+
+template <typename T>
+concept CharsConvertible = std::is_arithmetic_v<T> && requires(T value) {
+  std::from_chars(static_cast<const char*>(nullptr),
+                  static_cast<const char*>(nullptr), value);
+};
+
+// Fails unless the whole literal is consumed and fits into T.
+template <typename T>
+bool TryParseOperand(std::string_view str_operand, T& operand) {
+  if constexpr (CharsConvertible<T>) {
+    const char* end = str_operand.data() + str_operand.size();
+    auto [ptr, ec] = std::from_chars(str_operand.data(), end, operand);
+    return ec == std::errc() && ptr == end;
+  } else {
+    std::stringstream string_stream{std::string(str_operand)};
+    return static_cast<bool>(string_stream >> operand) &&
+           string_stream.peek() == std::char_traits<char>::eof();
+  }
+}
+
+template <typename T>
+T ParseOperand(std::string_view str_operand) {
+  T operand = T();
+  if (!TryParseOperand(str_operand, operand)) {
+    throw InvalidExpr();
+  }
+  return operand;
+}
 
 template <typename T>
 class OperandToken : public AbstractToken {
@@ -19,14 +52,24 @@ class OperandToken : public AbstractToken {
 template <typename T>
 OperandToken<T>::OperandToken(const T& value)
     : AbstractToken(""), operand_(value) {
-  std::stringstream string_stream;
-  string_stream << value;
-  UpdateStringToken(string_stream.str());
+  if constexpr (CharsConvertible<T>) {
+    char buffer[64];
+    std::to_chars_result result;
+    if constexpr (std::is_floating_point_v<T>) {
+      // Same digits as the default ostream precision
+      result = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                             std::chars_format::general, 6);
+    } else {
+      result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    }
+    UpdateStringToken(std::string(buffer, result.ptr));
+  } else {
+    std::stringstream string_stream;
+    string_stream << value;
+    UpdateStringToken(string_stream.str());
+  }
 }
 
 template <typename T>
 OperandToken<T>::OperandToken(const std::string& str_operand)
-    : AbstractToken(str_operand) {
-  std::stringstream string_stream(str_operand);
-  string_stream >> operand_;
-}
+    : AbstractToken(str_operand), operand_(ParseOperand<T>(str_operand)) {}
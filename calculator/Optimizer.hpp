@@ -0,0 +1,264 @@
+#pragma once
+#include <cstring>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ExprInPolishNotation.hpp"
+#include "InvalidExpr.hpp"
+#include "OperatorToken.hpp"
+#include "Program.hpp"
+#include "Token.hpp"
+
+// Turns the parsed expression into a DAG, folding constant subexpressions
+// and identities as nodes are created and sharing structurally equal nodes,
+// then emits the DAG as a Program. Shared subexpressions are computed once
+// and reloaded from temporaries.
+template <typename T>
+class Optimizer {
+ public:
+  static Program<T> Optimize(const ExprInPolishNotation<T>& expr,
+                             const std::vector<std::string>& variables = {});
+
+ private:
+  struct Node {
+    bytecode::OpCode code;
+    uint32_t index = 0;
+    uint32_t lhs = 0;
+    uint32_t rhs = 0;
+  };
+
+  using NodeKey = std::tuple<bytecode::OpCode, uint64_t, uint32_t, uint32_t>;
+
+  static std::optional<uint64_t> ConstantKey(const T& value);
+
+  bool IsConstant(uint32_t node, const T& value) const;
+
+  uint32_t AddNode(const Node& node, std::optional<uint64_t> key);
+
+  uint32_t AddConstant(const T& value);
+
+  uint32_t AddLoad(uint32_t slot);
+
+  uint32_t AddUnary(char operation, uint32_t operand);
+
+  uint32_t AddBinary(char operation, uint32_t lhs, uint32_t rhs);
+
+  Program<T> Emit(uint32_t root, size_t variable_count) const;
+
+  std::vector<Node> nodes_;
+  std::vector<T> constants_;
+  std::map<NodeKey, uint32_t> known_nodes_;
+};
+
+template <typename T>
+std::optional<uint64_t> Optimizer<T>::ConstantKey(const T& value) {
+  if constexpr (std::is_arithmetic_v<T> && sizeof(T) <= sizeof(uint64_t)) {
+    uint64_t key = 0;
+    std::memcpy(&key, &value, sizeof(T));
+    return key;
+  }
+  return std::nullopt;
+}
+
+template <typename T>
+bool Optimizer<T>::IsConstant(uint32_t node, const T& value) const {
+  if (nodes_[node].code != bytecode::OpCode::kPush) {
+    return false;
+  }
+  // Bitwise where possible, so that -0.0 does not count as 0.
+  const T& constant = constants_[nodes_[node].index];
+  std::optional<uint64_t> key = ConstantKey(value);
+  return key.has_value() ? ConstantKey(constant) == key : constant == value;
+}
+
+template <typename T>
+uint32_t Optimizer<T>::AddNode(const Node& node, std::optional<uint64_t> key) {
+  NodeKey node_key{node.code, key.value_or(0), node.lhs, node.rhs};
+  if (key.has_value()) {
+    auto known = known_nodes_.find(node_key);
+    if (known != known_nodes_.end()) {
+      return known->second;
+    }
+  }
+  nodes_.push_back(node);
+  auto id = static_cast<uint32_t>(nodes_.size() - 1);
+  if (key.has_value()) {
+    known_nodes_.emplace(node_key, id);
+  }
+  return id;
+}
+
+template <typename T>
+uint32_t Optimizer<T>::AddConstant(const T& value) {
+  std::optional<uint64_t> key = ConstantKey(value);
+  if (key.has_value()) {
+    auto known = known_nodes_.find({bytecode::OpCode::kPush, *key, 0, 0});
+    if (known != known_nodes_.end()) {
+      return known->second;
+    }
+  }
+  constants_.push_back(value);
+  return AddNode(
+      {bytecode::OpCode::kPush, static_cast<uint32_t>(constants_.size() - 1)},
+      key);
+}
+
+template <typename T>
+uint32_t Optimizer<T>::AddLoad(uint32_t slot) {
+  return AddNode({bytecode::OpCode::kLoad, slot}, slot);
+}
+
+template <typename T>
+uint32_t Optimizer<T>::AddUnary(char operation, uint32_t operand) {
+  if (operation == '+') {
+    return operand;
+  }
+  const Node& node = nodes_[operand];
+  if (node.code == bytecode::OpCode::kPush) {
+    return AddConstant(operations::kUnaryOperations<T>.at(std::string(
+        1, operation))(constants_[node.index]));
+  }
+  if (node.code == bytecode::OpCode::kNegate) {
+    return node.lhs;
+  }
+  return AddNode({bytecode::OpCode::kNegate, 0, operand}, 0);
+}
+
+template <typename T>
+uint32_t Optimizer<T>::AddBinary(char operation, uint32_t lhs, uint32_t rhs) {
+  const Node& left = nodes_[lhs];
+  const Node& right = nodes_[rhs];
+  if (left.code == bytecode::OpCode::kPush &&
+      right.code == bytecode::OpCode::kPush &&
+      (operation != '/' ||
+       bytecode::IsDivisionDefined(constants_[left.index],
+                                   constants_[right.index]))) {
+    return AddConstant(operations::kBinaryOperations<T>.at(std::string(
+        1, operation))(constants_[left.index], constants_[right.index]));
+  }
+  // x + 0 is not x for floating point: -0.0 + 0 == +0.0.
+  bool drop_zero_addend = std::is_integral_v<T> && operation == '+';
+  if (((drop_zero_addend || operation == '-') && IsConstant(rhs, T(0))) ||
+      ((operation == '*' || operation == '/') && IsConstant(rhs, T(1)))) {
+    return lhs;
+  }
+  if ((drop_zero_addend && IsConstant(lhs, T(0))) ||
+      (operation == '*' && IsConstant(lhs, T(1)))) {
+    return rhs;
+  }
+  return AddNode({bytecode::kBinaryOpCodes.at(operation), 0, lhs, rhs}, 0);
+}
+
+template <typename T>
+Program<T> Optimizer<T>::Optimize(const ExprInPolishNotation<T>& expr,
+                                  const std::vector<std::string>& variables) {
+  Optimizer optimizer;
+  const std::vector<Token<T>>& tokens = expr.GetCompactTokens();
+  std::vector<uint32_t> stack;
+  for (auto token_it = tokens.rbegin(); token_it != tokens.rend(); ++token_it) {
+    switch (token_it->kind) {
+      case TokenKind::kOperand:
+        stack.push_back(optimizer.AddConstant(token_it->value));
+        break;
+      case TokenKind::kVariable: {
+        auto slot = std::find(variables.begin(), variables.end(),
+                              expr.GetText(*token_it));
+        if (slot == variables.end()) {
+          throw InvalidExpr();
+        }
+        stack.push_back(
+            optimizer.AddLoad(static_cast<uint32_t>(slot - variables.begin())));
+        break;
+      }
+      case TokenKind::kBinaryOperator: {
+        if (stack.size() < 2) {
+          throw InvalidExpr();
+        }
+        uint32_t lhs = stack.back();
+        stack.pop_back();
+        stack.back() =
+            optimizer.AddBinary(token_it->operation, lhs, stack.back());
+        break;
+      }
+      case TokenKind::kUnaryOperator:
+        if (stack.empty()) {
+          throw InvalidExpr();
+        }
+        stack.back() = optimizer.AddUnary(token_it->operation, stack.back());
+        break;
+    }
+  }
+  if (stack.size() != 1) {
+    throw InvalidExpr();
+  }
+  return optimizer.Emit(stack.back(), variables.size());
+}
+
+template <typename T>
+Program<T> Optimizer<T>::Emit(uint32_t root, size_t variable_count) const {
+  const uint32_t kNone = UINT32_MAX;
+  auto is_leaf = [](const Node& node) {
+    return node.code == bytecode::OpCode::kPush ||
+           node.code == bytecode::OpCode::kLoad;
+  };
+  auto is_binary = [&is_leaf](const Node& node) {
+    return !is_leaf(node) && node.code != bytecode::OpCode::kNegate;
+  };
+
+  // Children always have smaller ids than their parents.
+  std::vector<uint32_t> uses(root + 1, 0);
+  uses[root] = 1;
+  for (uint32_t id = root + 1; id-- > 0;) {
+    const Node& node = nodes_[id];
+    if (uses[id] == 0 || is_leaf(node)) {
+      continue;
+    }
+    ++uses[node.lhs];
+    if (is_binary(node)) {
+      ++uses[node.rhs];
+    }
+  }
+
+  std::vector<bytecode::Instruction> code;
+  std::vector<T> constants;
+  std::vector<uint32_t> constant_of(constants_.size(), kNone);
+  std::vector<uint32_t> temp_of(root + 1, kNone);
+  size_t temp_count = 0;
+  std::vector<std::pair<uint32_t, bool>> pending{{root, false}};
+  while (!pending.empty()) {
+    auto [id, expanded] = pending.back();
+    pending.pop_back();
+    const Node& node = nodes_[id];
+    if (temp_of[id] != kNone) {
+      code.push_back({bytecode::OpCode::kLoadTemp, temp_of[id]});
+    } else if (node.code == bytecode::OpCode::kPush) {
+      if (constant_of[node.index] == kNone) {
+        constant_of[node.index] = static_cast<uint32_t>(constants.size());
+        constants.push_back(constants_[node.index]);
+      }
+      code.push_back({node.code, constant_of[node.index]});
+    } else if (node.code == bytecode::OpCode::kLoad) {
+      code.push_back({node.code, node.index});
+    } else if (!expanded) {
+      // The right operand is emitted first, so the left one ends up on top.
+      pending.emplace_back(id, true);
+      pending.emplace_back(node.lhs, false);
+      if (is_binary(node)) {
+        pending.emplace_back(node.rhs, false);
+      }
+    } else {
+      code.push_back({node.code});
+      if (uses[id] > 1) {
+        temp_of[id] = static_cast<uint32_t>(temp_count++);
+        code.push_back({bytecode::OpCode::kStore, temp_of[id]});
+      }
+    }
+  }
+  return Program<T>(std::move(code), std::move(constants), temp_count,
+                    variable_count);
+}
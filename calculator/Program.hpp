@@ -0,0 +1,382 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "ExprInPolishNotation.hpp"
+#include "InvalidExpr.hpp"
+#include "Token.hpp"
+
+namespace bytecode {
+enum class OpCode : uint8_t {
+  kPush,
+  kLoad,
+  kAdd,
+  kSubtract,
+  kMultiply,
+  kDivide,
+  kNegate,
+  kStore,
+  kLoadTemp,
+};
+
+struct Instruction {
+  OpCode code;
+  uint32_t index = 0;
+};
+
+const std::unordered_map<char, OpCode> kBinaryOpCodes{
+    {'+', OpCode::kAdd},
+    {'-', OpCode::kSubtract},
+    {'*', OpCode::kMultiply},
+    {'/', OpCode::kDivide}};
+
+const size_t kInlineStackSize = 64;
+
+// False where integer division traps: by zero, or the most negative value
+// divided by -1.
+template <typename T>
+bool IsDivisionDefined(const T& lhs, const T& rhs) {
+  if constexpr (std::is_integral_v<T>) {
+    if (rhs == T(0)) {
+      return false;
+    }
+    if constexpr (std::is_signed_v<T>) {
+      return !(lhs == std::numeric_limits<T>::min() && rhs == T(-1));
+    }
+  }
+  return true;
+}
+
+const size_t kColumnBlockSize = 256;
+
+// Runs body for every row of a block. At -O2 GCC only vectorizes loops that
+// need neither a scalar epilogue nor runtime alias checks, so full blocks get
+// a constant trip count and ivdep. Rows are independent: a result block is
+// either distinct from the operands or the same block updated row by row.
+template <typename Body>
+void ForEachRow(size_t count, Body body) {
+  if (count == kColumnBlockSize) {
+#pragma GCC ivdep
+    for (size_t i = 0; i < kColumnBlockSize; ++i) {
+      body(i);
+    }
+    return;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    body(i);
+  }
+}
+
+template <typename T, typename Operation>
+void ApplyColumns(const T* lhs, const T* rhs, T* result, size_t count,
+                  Operation operation) {
+  ForEachRow(count, [&](size_t i) { result[i] = operation(lhs[i], rhs[i]); });
+}
+}  // namespace bytecode
+
+template <typename T>
+class Optimizer;
+
+// Flat, immutable form of an expression. Instructions are the Polish
+// notation tokens in reverse order, so binary operations find their left
+// operand on top of the stack. kStore copies the top of the stack into a
+// temporary that kLoadTemp pushes again later.
+template <typename T>
+class Program {
+ public:
+  Program() = default;
+
+  Program(const ExprInPolishNotation<T>& expr,
+          const std::vector<std::string>& variables = {});
+
+  // Non-throwing counterpart of the constructor. Reuses the buffers of the
+  // previous program.
+  bool TryCompile(const ExprInPolishNotation<T>& expr,
+                  const std::vector<std::string>& variables = {});
+
+  T Evaluate() const { return Evaluate(std::span<const T>()); }
+
+  T Evaluate(std::span<const T> values) const;
+
+  // Fails instead of trapping on an undefined integer division.
+  bool TryEvaluate(std::span<const T> values, T& result) const;
+
+  void EvaluateColumns(std::span<const T* const> columns,
+                       std::span<T> results) const;
+
+  const std::vector<bytecode::Instruction>& GetCode() const { return code_; }
+
+  const std::vector<T>& GetConstants() const { return constants_; }
+
+  size_t StackDepth() const { return stack_depth_; }
+
+  size_t VariableCount() const { return variable_count_; }
+
+  size_t TempCount() const { return temp_count_; }
+
+ private:
+  Program(std::vector<bytecode::Instruction> code, std::vector<T> constants,
+          size_t temp_count, size_t variable_count);
+
+  template <bool kChecked>
+  bool Execute(const T* values, T& result) const;
+
+  template <bool kChecked>
+  bool Run(T* stack, T* temps, const T* values, T& result) const;
+
+  void RunBlock(const T* const* columns, size_t row, size_t count,
+                const T** stack, T* scratch, T* temps) const;
+
+  friend class Optimizer<T>;
+
+  std::vector<bytecode::Instruction> code_;
+  std::vector<T> constants_;
+  size_t stack_depth_ = 0;
+  size_t temp_count_ = 0;
+  size_t variable_count_ = 0;
+};
+
+template <typename T>
+Program<T>::Program(std::vector<bytecode::Instruction> code,
+                    std::vector<T> constants, size_t temp_count,
+                    size_t variable_count)
+    : code_(std::move(code)),
+      constants_(std::move(constants)),
+      temp_count_(temp_count),
+      variable_count_(variable_count) {
+  size_t depth = 0;
+  for (const bytecode::Instruction& instruction : code_) {
+    switch (instruction.code) {
+      case bytecode::OpCode::kPush:
+      case bytecode::OpCode::kLoad:
+      case bytecode::OpCode::kLoadTemp:
+        stack_depth_ = std::max(stack_depth_, ++depth);
+        break;
+      case bytecode::OpCode::kNegate:
+      case bytecode::OpCode::kStore:
+        break;
+      default:
+        --depth;
+    }
+  }
+}
+
+template <typename T>
+Program<T>::Program(const ExprInPolishNotation<T>& expr,
+                    const std::vector<std::string>& variables) {
+  if (!TryCompile(expr, variables)) {
+    throw InvalidExpr();
+  }
+}
+
+template <typename T>
+bool Program<T>::TryCompile(const ExprInPolishNotation<T>& expr,
+                            const std::vector<std::string>& variables) {
+  const std::vector<Token<T>>& tokens = expr.GetCompactTokens();
+  code_.clear();
+  constants_.clear();
+  code_.reserve(tokens.size());
+  stack_depth_ = 0;
+  temp_count_ = 0;
+  variable_count_ = variables.size();
+  size_t depth = 0;
+  for (auto token_it = tokens.rbegin(); token_it != tokens.rend(); ++token_it) {
+    switch (token_it->kind) {
+      case TokenKind::kOperand:
+        code_.push_back({bytecode::OpCode::kPush,
+                         static_cast<uint32_t>(constants_.size())});
+        constants_.push_back(token_it->value);
+        stack_depth_ = std::max(stack_depth_, ++depth);
+        break;
+      case TokenKind::kVariable: {
+        auto slot = std::find(variables.begin(), variables.end(),
+                              expr.GetText(*token_it));
+        if (slot == variables.end()) {
+          return false;
+        }
+        code_.push_back({bytecode::OpCode::kLoad,
+                         static_cast<uint32_t>(slot - variables.begin())});
+        stack_depth_ = std::max(stack_depth_, ++depth);
+        break;
+      }
+      case TokenKind::kBinaryOperator:
+        if (depth < 2) {
+          return false;
+        }
+        --depth;
+        code_.push_back({bytecode::kBinaryOpCodes.at(token_it->operation)});
+        break;
+      case TokenKind::kUnaryOperator:
+        if (depth < 1) {
+          return false;
+        }
+        if (token_it->operation == '-') {
+          code_.push_back({bytecode::OpCode::kNegate});
+        }
+        break;
+    }
+  }
+  return depth == 1;
+}
+
+template <typename T>
+T Program<T>::Evaluate(std::span<const T> values) const {
+  if (values.size() < variable_count_) {
+    throw std::out_of_range("Program: not enough variable values");
+  }
+  T result = T();
+  Execute<false>(values.data(), result);
+  return result;
+}
+
+template <typename T>
+bool Program<T>::TryEvaluate(std::span<const T> values, T& result) const {
+  return values.size() >= variable_count_ &&
+         Execute<true>(values.data(), result);
+}
+
+template <typename T>
+template <bool kChecked>
+bool Program<T>::Execute(const T* values, T& result) const {
+  size_t size = stack_depth_ + temp_count_;
+  if (size <= bytecode::kInlineStackSize) {
+    T stack[bytecode::kInlineStackSize];
+    return Run<kChecked>(stack, stack + stack_depth_, values, result);
+  }
+  std::vector<T> stack(size);
+  return Run<kChecked>(stack.data(), stack.data() + stack_depth_, values,
+                       result);
+}
+
+template <typename T>
+template <bool kChecked>
+bool Program<T>::Run(T* stack, T* temps, const T* values, T& result) const {
+  T* top = stack;
+  for (const bytecode::Instruction& instruction : code_) {
+    switch (instruction.code) {
+      case bytecode::OpCode::kPush:
+        *top++ = constants_[instruction.index];
+        break;
+      case bytecode::OpCode::kLoad:
+        *top++ = values[instruction.index];
+        break;
+      case bytecode::OpCode::kAdd:
+        --top;
+        top[-1] = top[0] + top[-1];
+        break;
+      case bytecode::OpCode::kSubtract:
+        --top;
+        top[-1] = top[0] - top[-1];
+        break;
+      case bytecode::OpCode::kMultiply:
+        --top;
+        top[-1] = top[0] * top[-1];
+        break;
+      case bytecode::OpCode::kDivide:
+        --top;
+        if constexpr (kChecked) {
+          if (!bytecode::IsDivisionDefined(top[0], top[-1])) {
+            return false;
+          }
+        }
+        top[-1] = top[0] / top[-1];
+        break;
+      case bytecode::OpCode::kNegate:
+        top[-1] = -top[-1];
+        break;
+      case bytecode::OpCode::kStore:
+        temps[instruction.index] = top[-1];
+        break;
+      case bytecode::OpCode::kLoadTemp:
+        *top++ = temps[instruction.index];
+        break;
+    }
+  }
+  result = stack[0];
+  return true;
+}
+
+// Evaluates the program for every row, reading variable slot i of row j from
+// columns[i][j]. Each instruction is applied to a whole block of rows at a
+// time, so the inner loops are plain array loops the compiler vectorizes
+// (see bytecode::ForEachRow).
+template <typename T>
+void Program<T>::EvaluateColumns(std::span<const T* const> columns,
+                                 std::span<T> results) const {
+  if (columns.size() < variable_count_) {
+    throw std::out_of_range("Program: not enough variable columns");
+  }
+  std::vector<const T*> stack(stack_depth_);
+  std::vector<T> scratch((stack_depth_ + temp_count_) *
+                         bytecode::kColumnBlockSize);
+  T* temps = scratch.data() + stack_depth_ * bytecode::kColumnBlockSize;
+  for (size_t row = 0; row < results.size();
+       row += bytecode::kColumnBlockSize) {
+    size_t count = std::min(bytecode::kColumnBlockSize, results.size() - row);
+    RunBlock(columns.data(), row, count, stack.data(), scratch.data(), temps);
+    std::copy(stack[0], stack[0] + count, results.data() + row);
+  }
+}
+
+template <typename T>
+void Program<T>::RunBlock(const T* const* columns, size_t row, size_t count,
+                          const T** stack, T* scratch, T* temps) const {
+  size_t top = 0;
+  for (const bytecode::Instruction& instruction : code_) {
+    if (instruction.code == bytecode::OpCode::kPush) {
+      T* block = scratch + top * bytecode::kColumnBlockSize;
+      std::fill(block, block + count, constants_[instruction.index]);
+      stack[top++] = block;
+      continue;
+    }
+    if (instruction.code == bytecode::OpCode::kLoad) {
+      stack[top++] = columns[instruction.index] + row;
+      continue;
+    }
+    if (instruction.code == bytecode::OpCode::kStore) {
+      T* block = temps + instruction.index * bytecode::kColumnBlockSize;
+      std::copy(stack[top - 1], stack[top - 1] + count, block);
+      continue;
+    }
+    if (instruction.code == bytecode::OpCode::kLoadTemp) {
+      stack[top++] = temps + instruction.index * bytecode::kColumnBlockSize;
+      continue;
+    }
+    if (instruction.code == bytecode::OpCode::kNegate) {
+      T* block = scratch + (top - 1) * bytecode::kColumnBlockSize;
+      const T* operand = stack[top - 1];
+      bytecode::ForEachRow(count, [&](size_t i) { block[i] = -operand[i]; });
+      stack[top - 1] = block;
+      continue;
+    }
+    --top;
+    const T* lhs = stack[top];
+    const T* rhs = stack[top - 1];
+    T* block = scratch + (top - 1) * bytecode::kColumnBlockSize;
+    switch (instruction.code) {
+      case bytecode::OpCode::kAdd:
+        bytecode::ApplyColumns(lhs, rhs, block, count, std::plus<T>());
+        break;
+      case bytecode::OpCode::kSubtract:
+        bytecode::ApplyColumns(lhs, rhs, block, count, std::minus<T>());
+        break;
+      case bytecode::OpCode::kMultiply:
+        bytecode::ApplyColumns(lhs, rhs, block, count, std::multiplies<T>());
+        break;
+      case bytecode::OpCode::kDivide:
+        bytecode::ApplyColumns(lhs, rhs, block, count, std::divides<T>());
+        break;
+      default:
+        break;
+    }
+    stack[top - 1] = block;
+  }
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ExprInPolishNotation.hpp"
+#include "Optimizer.hpp"
+#include "Program.hpp"
+
+// Bounded LRU cache of compiled programs keyed by normalized expression text
+// and variable bindings. Keys are spread over independently locked shards,
+// each with its own recency list; programs are compiled outside the lock.
+template <typename T>
+class ProgramCache {
+ public:
+  using ProgramPtr = std::shared_ptr<const Program<T>>;
+
+  explicit ProgramCache(size_t capacity, size_t shard_count = 16);
+
+  ProgramPtr Get(std::string_view expr,
+                 const std::vector<std::string>& variables = {});
+
+  size_t Hits() const;
+
+  size_t Misses() const;
+
+  size_t Size() const;
+
+  static std::string Normalize(std::string_view expr);
+
+ private:
+  // Counters live next to the mutex so lookups on different shards never
+  // write to a shared cache line.
+  struct alignas(64) Shard {
+    using Entry = std::pair<std::string, ProgramPtr>;
+
+    mutable std::mutex mutex;
+    std::list<Entry> order;
+    std::unordered_map<std::string_view, typename std::list<Entry>::iterator>
+        index;
+    std::atomic<size_t> hits = 0;
+    std::atomic<size_t> misses = 0;
+  };
+
+  static std::string MakeKey(std::string_view expr,
+                             const std::vector<std::string>& variables);
+
+  std::vector<Shard> shards_;
+  size_t shard_capacity_;
+};
+
+template <typename T>
+ProgramCache<T>::ProgramCache(size_t capacity, size_t shard_count)
+    : shards_(std::max<size_t>(shard_count, 1)),
+      shard_capacity_(std::max<size_t>(
+          (capacity + shards_.size() - 1) / shards_.size(), 1)) {}
+
+// Drops whitespace except between two literals, where it separates tokens.
+template <typename T>
+std::string ProgramCache<T>::Normalize(std::string_view expr) {
+  std::string normalized;
+  normalized.reserve(expr.size());
+  bool space = false;
+  for (char symbol : expr) {
+    tokens::CharClass char_class = tokens::GetCharClass(symbol);
+    if (char_class == tokens::CharClass::kSpace) {
+      space = true;
+      continue;
+    }
+    if (space && char_class == tokens::CharClass::kLiteral &&
+        !normalized.empty() &&
+        tokens::GetCharClass(normalized.back()) ==
+            tokens::CharClass::kLiteral) {
+      normalized.push_back(' ');
+    }
+    space = false;
+    normalized.push_back(symbol);
+  }
+  return normalized;
+}
+
+template <typename T>
+std::string ProgramCache<T>::MakeKey(
+    std::string_view expr, const std::vector<std::string>& variables) {
+  std::string key = Normalize(expr);
+  for (const std::string& variable : variables) {
+    key.push_back('\0');
+    key += variable;
+  }
+  return key;
+}
+
+template <typename T>
+typename ProgramCache<T>::ProgramPtr ProgramCache<T>::Get(
+    std::string_view expr, const std::vector<std::string>& variables) {
+  std::string key = MakeKey(expr, variables);
+  Shard& shard = shards_[std::hash<std::string>()(key) % shards_.size()];
+  {
+    std::lock_guard lock(shard.mutex);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+      shard.order.splice(shard.order.begin(), shard.order, found->second);
+      shard.hits.fetch_add(1, std::memory_order_relaxed);
+      return found->second->second;
+    }
+    shard.misses.fetch_add(1, std::memory_order_relaxed);
+  }
+  auto program = std::make_shared<const Program<T>>(
+      Optimizer<T>::Optimize(ExprInPolishNotation<T>(expr), variables));
+
+  std::lock_guard lock(shard.mutex);
+  auto found = shard.index.find(key);
+  if (found != shard.index.end()) {
+    shard.order.splice(shard.order.begin(), shard.order, found->second);
+    return found->second->second;
+  }
+  shard.order.emplace_front(std::move(key), program);
+  shard.index.emplace(shard.order.front().first, shard.order.begin());
+  if (shard.order.size() > shard_capacity_) {
+    shard.index.erase(shard.order.back().first);
+    shard.order.pop_back();
+  }
+  return program;
+}
+
+template <typename T>
+size_t ProgramCache<T>::Hits() const {
+  size_t hits = 0;
+  for (const Shard& shard : shards_) {
+    hits += shard.hits.load(std::memory_order_relaxed);
+  }
+  return hits;
+}
+
+template <typename T>
+size_t ProgramCache<T>::Misses() const {
+  size_t misses = 0;
+  for (const Shard& shard : shards_) {
+    misses += shard.misses.load(std::memory_order_relaxed);
+  }
+  return misses;
+}
+
+template <typename T>
+size_t ProgramCache<T>::Size() const {
+  size_t size = 0;
+  for (const Shard& shard : shards_) {
+    std::lock_guard lock(shard.mutex);
+    size += shard.order.size();
+  }
+  return size;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+enum class TokenKind : uint8_t {
+  kOperand,
+  kVariable,
+  kBinaryOperator,
+  kUnaryOperator,
+};
+
+// Compact counterpart of the AbstractToken hierarchy, stored by value.
+// Literals keep the position of their text in the parsed expression.
+template <typename T>
+struct Token {
+  TokenKind kind;
+  char operation = '\0';
+  uint32_t text_offset = 0;
+  uint32_t text_size = 0;
+  T value = T();
+};
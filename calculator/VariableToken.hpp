@@ -0,0 +1,9 @@
+#pragma once
+#include "AbstractToken.hpp"
+
+class VariableToken : public AbstractToken {
+ public:
+  VariableToken(const std::string& name) : AbstractToken(name){};
+
+  const std::string& GetName() const { return GetStringToken(); }
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Threads kept alive between CalculateBatch calls. Run lets up to `helpers`
+// pool threads call task next to the calling thread and returns once every
+// started call has finished, so task has to split the work on its own. A
+// caller that finds the pool busy, or cannot get any threads, runs task alone.
+class WorkerPool {
+ public:
+  static WorkerPool& Instance() {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  void Run(const std::function<void()>& task, size_t helpers);
+
+  ~WorkerPool();
+
+ private:
+  size_t Offer(const std::function<void()>& task, size_t helpers);
+
+  void Finish();
+
+  void Work();
+
+  std::mutex run_mutex_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::vector<std::thread> threads_;
+  const std::function<void()>* task_ = nullptr;
+  size_t offered_ = 0;
+  size_t active_ = 0;
+  bool stopping_ = false;
+};
+
+inline void WorkerPool::Run(const std::function<void()>& task,
+                            size_t helpers) {
+  std::unique_lock run_lock(run_mutex_, std::try_to_lock);
+  if (!run_lock.owns_lock() || helpers == 0 || Offer(task, helpers) == 0) {
+    task();
+    return;
+  }
+  try {
+    task();
+  } catch (...) {
+    Finish();
+    throw;
+  }
+  Finish();
+}
+
+// Starts missing threads; if the system refuses, the ones already running
+// are used.
+inline size_t WorkerPool::Offer(const std::function<void()>& task,
+                                size_t helpers) {
+  std::lock_guard lock(mutex_);
+  try {
+    while (threads_.size() < helpers) {
+      threads_.emplace_back([this] { Work(); });
+    }
+  } catch (const std::system_error&) {
+  }
+  task_ = &task;
+  offered_ = std::min(helpers, threads_.size());
+  wake_.notify_all();
+  return offered_;
+}
+
+// Withdraws the offers nobody has taken yet and waits for the rest.
+inline void WorkerPool::Finish() {
+  std::unique_lock lock(mutex_);
+  offered_ = 0;
+  done_.wait(lock, [this] { return active_ == 0; });
+  task_ = nullptr;
+}
+
+inline void WorkerPool::Work() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [this] { return stopping_ || offered_ != 0; });
+    if (stopping_) {
+      return;
+    }
+    --offered_;
+    ++active_;
+    const std::function<void()>* task = task_;
+    lock.unlock();
+    (*task)();
+    lock.lock();
+    if (--active_ == 0) {
+      done_.notify_all();
+    }
+  }
+}
+
+inline WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
@@ -0,0 +1,86 @@
+// Benchmark of compiled Programs against parsing with CalculateExpr.
+//   g++ -std=c++20 -O2 -pthread -I calculator calculator/benchmark.cpp -o benchmark
+// Every expression is evaluated kIterations times: parsed anew by
+// CalculateExpr, looked up in a ProgramCache, and run from a Program
+// compiled once. Prints nanoseconds per evaluation, the best of kRepeats
+// runs, and exits with a non-zero status if the three disagree.
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Calculator.hpp"
+
+namespace {
+const int kRepeats = 5;
+const int kIterations = 200'000;
+
+const std::vector<std::string> kExpressions = {
+    "1 + 2",
+    "(1 + 2) * (3 - 4) / 5",
+    "((7 * 3 - 4) * (2 + 9) - (8 - 6) * 5) / (3 + 4 * (2 - 1))",
+    "-(1 + 2 * (3 + 4 * (5 + 6 * (7 + 8 * (9 + 1))))) - 2 * (3 - 4 * 5)",
+};
+
+template <typename T>
+void KeepAlive(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+template <typename Body>
+double BestNanosecondsPerEvaluation(const Body& body) {
+  double best = 0;
+  for (int repeat = 0; repeat < kRepeats; ++repeat) {
+    auto start = std::chrono::steady_clock::now();
+    for (int iteration = 0; iteration < kIterations; ++iteration) {
+      KeepAlive(body());
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double per_evaluation = elapsed.count() / kIterations;
+    best = repeat == 0 ? per_evaluation : std::min(best, per_evaluation);
+  }
+  return best;
+}
+
+template <typename T>
+bool SameBits(const T& lhs, const T& rhs) {
+  return std::memcmp(&lhs, &rhs, sizeof(T)) == 0;
+}
+
+template <typename T>
+int RunBenchmark(const char* type_name) {
+  ProgramCache<T> cache(kExpressions.size());
+  std::cout << type_name
+            << "\nns/eval       CalculateExpr     cached   Program\n";
+  for (size_t expr_idx = 0; expr_idx < kExpressions.size(); ++expr_idx) {
+    const std::string& expr = kExpressions[expr_idx];
+    Program<T> program{ExprInPolishNotation<T>(expr)};
+    T parsed = Calculator<T>::CalculateExpr(expr);
+    if (!SameBits(parsed, Calculator<T>::CalculateExpr(expr, cache)) ||
+        !SameBits(parsed, program.Evaluate())) {
+      std::cerr << type_name << ": results differ for " << expr << "\n";
+      return 1;
+    }
+    std::cout << "expression " << expr_idx << std::fixed
+              << std::setprecision(1) << std::setw(17)
+              << BestNanosecondsPerEvaluation(
+                     [&] { return Calculator<T>::CalculateExpr(expr); })
+              << std::setw(11)
+              << BestNanosecondsPerEvaluation(
+                     [&] { return Calculator<T>::CalculateExpr(expr, cache); })
+              << std::setw(10)
+              << BestNanosecondsPerEvaluation(
+                     [&] { return program.Evaluate(); })
+              << "\n";
+  }
+  return 0;
+}
+}  // namespace
+
+int main() {
+  return RunBenchmark<double>("double") | RunBenchmark<int64_t>("int64_t");
+}
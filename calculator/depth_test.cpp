@@ -0,0 +1,105 @@
+// Deep nesting test of every Calculator entry point.
+//   g++ -std=c++20 -O2 -I calculator calculator/depth_test.cpp -o depth_test
+// Expressions nested kDepth levels deep go through CalculateTokens and
+// CalculateExpr with literal operands, and through Compile and CompileNative
+// with a variable bound to the same value. All four must finish without
+// exhausting the call stack and agree on the expected result. Exits with a
+// non-zero status on the first wrong result.
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Calculator.hpp"
+
+namespace {
+const int kDepth = 1'000'000;
+
+struct DeepExpression {
+  const char* name;
+  std::function<std::string(const std::string&)> build;
+  int64_t expected;
+};
+
+std::string Repeat(const std::string& part, int count) {
+  std::string result;
+  result.reserve(part.size() * count);
+  for (int i = 0; i < count; ++i) {
+    result += part;
+  }
+  return result;
+}
+
+// operand stands for every leaf, "1" for the literal entry points and "x"
+// for the compiled ones.
+const std::vector<DeepExpression> kExpressions = {
+    {"nested brackets",
+     [](const std::string& operand) {
+       return Repeat("(", kDepth) + operand + Repeat(")", kDepth);
+     },
+     1},
+    {"left-nested sum",
+     [](const std::string& operand) {
+       return Repeat("(", kDepth) + operand +
+              Repeat(" + " + operand + ")", kDepth);
+     },
+     kDepth + 1},
+    {"right-nested sum",
+     [](const std::string& operand) {
+       return Repeat(operand + " + (", kDepth) + operand + Repeat(")", kDepth);
+     },
+     kDepth + 1},
+    {"unary chain",
+     [](const std::string& operand) {
+       return Repeat("-(", kDepth) + operand + Repeat(")", kDepth);
+     },
+     kDepth % 2 == 0 ? 1 : -1},
+};
+
+int64_t CalculateTokens(const std::string& expr) {
+  ExprInPolishNotation<int64_t> polish(expr);
+  const std::vector<AbstractToken*>& parsed = polish.GetTokens();
+  std::deque<AbstractToken*> tokens(parsed.begin(), parsed.end());
+  Calculator<int64_t>::CalculateTokens(tokens);
+  auto* result = dynamic_cast<OperandToken<int64_t>*>(tokens.front());
+  int64_t value = result->GetValue();
+  delete result;
+  return value;
+}
+
+bool Check(const char* expression_name, const char* entry_point,
+           int64_t expected, int64_t actual) {
+  if (expected == actual) {
+    return true;
+  }
+  std::cerr << expression_name << " through " << entry_point << ": expected "
+            << expected << ", got " << actual << "\n";
+  return false;
+}
+}  // namespace
+
+int main() {
+  bool passed = true;
+  for (const DeepExpression& expression : kExpressions) {
+    std::string literal = expression.build("1");
+    std::string variable = expression.build("x");
+    const int64_t x[] = {1};
+    passed &= Check(expression.name, "CalculateTokens", expression.expected,
+                    CalculateTokens(literal));
+    passed &= Check(expression.name, "CalculateExpr", expression.expected,
+                    Calculator<int64_t>::CalculateExpr(literal));
+    passed &= Check(expression.name, "Compile", expression.expected,
+                    Calculator<int64_t>::Compile(variable, {"x"}).Evaluate(x));
+    passed &= Check(
+        expression.name, "CompileNative", expression.expected,
+        Calculator<int64_t>::CompileNative(variable, {"x"}).Evaluate(x));
+  }
+  if (!passed) {
+    return 1;
+  }
+  std::cout << kExpressions.size() << " expressions nested " << kDepth
+            << " deep agree across all entry points\n";
+  return 0;
+}
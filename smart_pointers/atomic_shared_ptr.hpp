@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "smart_pointers.hpp"
+
+// Split reference count: the packed word holds a pointer to a node that owns
+// a SharedPtr plus a count of readers currently copying out of that node.
+// A reader bumps the packed count, copies the SharedPtr and hands its hold
+// back, so loads never wait on a writer. A writer that swaps a node out moves
+// the remaining outer count into the node's inner count; whoever brings the
+// inner count to zero frees the node.
+//
+// Published objects must not come from MakeLocalShared; kBiased blocks are
+// safe to copy from any thread.
+template <typename T>
+class AtomicSharedPtr {
+ public:
+  AtomicSharedPtr() = default;
+
+  AtomicSharedPtr(SharedPtr<T> desired) : word_(pack(make_node(desired), 0)) {}
+
+  AtomicSharedPtr(const AtomicSharedPtr&) = delete;
+
+  AtomicSharedPtr& operator=(const AtomicSharedPtr&) = delete;
+
+  AtomicSharedPtr& operator=(SharedPtr<T> desired) {
+    store(std::move(desired));
+    return *this;
+  }
+
+  operator SharedPtr<T>() const { return load(); }
+
+  SharedPtr<T> load() const;
+
+  void store(SharedPtr<T> desired) { exchange(std::move(desired)); }
+
+  SharedPtr<T> exchange(SharedPtr<T> desired);
+
+  bool compare_exchange_strong(SharedPtr<T>& expected, SharedPtr<T> desired);
+
+  bool compare_exchange_weak(SharedPtr<T>& expected, SharedPtr<T> desired) {
+    return compare_exchange_strong(expected, std::move(desired));
+  }
+
+  bool is_lock_free() const { return word_.is_lock_free(); }
+
+  ~AtomicSharedPtr() { delete node_of(word_.load(std::memory_order_acquire)); }
+
+ private:
+  struct Node {
+    SharedPtr<T> value;
+    std::atomic<int64_t> inner_count = 0;
+  };
+
+  static_assert(sizeof(void*) == sizeof(uint64_t),
+                "AtomicSharedPtr packs a 48-bit pointer and a 16-bit count");
+  static constexpr int kCountShift = 48;
+  static constexpr uint64_t kPointerMask = (uint64_t(1) << kCountShift) - 1;
+  static constexpr uint64_t kCountUnit = uint64_t(1) << kCountShift;
+
+  static uint64_t pack(Node* node, uint64_t count) {
+    return reinterpret_cast<uintptr_t>(node) | (count << kCountShift);
+  }
+
+  static Node* node_of(uint64_t word) {
+    return reinterpret_cast<Node*>(word & kPointerMask);
+  }
+
+  static uint64_t count_of(uint64_t word) { return word >> kCountShift; }
+
+  static Node* make_node(SharedPtr<T>& value) {
+    return value.control_ ? new Node{std::move(value)} : nullptr;
+  }
+
+  static bool same(const SharedPtr<T>& lhs, const SharedPtr<T>& rhs) {
+    return lhs.ptr_ == rhs.ptr_ && lhs.control_ == rhs.control_;
+  }
+
+  uint64_t acquire() const {
+    return word_.fetch_add(kCountUnit, std::memory_order_acquire);
+  }
+
+  void release(Node* node) const;
+
+  static void retire(Node* node, uint64_t outer_count);
+
+  mutable std::atomic<uint64_t> word_ = 0;
+};
+
+// Hands the hold back to the packed count while the node is still
+// published, otherwise settles it against the node's inner count.
+template <typename T>
+void AtomicSharedPtr<T>::release(Node* node) const {
+  uint64_t word = word_.load(std::memory_order_relaxed);
+  while (node_of(word) == node && count_of(word) != 0) {
+    if (word_.compare_exchange_weak(word, word - kCountUnit,
+                                    std::memory_order_release,
+                                    std::memory_order_relaxed)) {
+      return;
+    }
+  }
+  if (node && node->inner_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete node;
+  }
+}
+
+template <typename T>
+void AtomicSharedPtr<T>::retire(Node* node, uint64_t outer_count) {
+  int64_t outer = static_cast<int64_t>(outer_count);
+  if (node &&
+      node->inner_count.fetch_add(outer, std::memory_order_acq_rel) == -outer) {
+    delete node;
+  }
+}
+
+template <typename T>
+SharedPtr<T> AtomicSharedPtr<T>::load() const {
+  Node* node = node_of(acquire());
+  SharedPtr<T> result;
+  if (node) {
+    result = node->value;
+  }
+  release(node);
+  return result;
+}
+
+template <typename T>
+SharedPtr<T> AtomicSharedPtr<T>::exchange(SharedPtr<T> desired) {
+  uint64_t old = word_.exchange(pack(make_node(desired), 0),
+                                std::memory_order_acq_rel);
+  Node* node = node_of(old);
+  SharedPtr<T> result;
+  if (node) {
+    result = node->value;
+  }
+  retire(node, count_of(old));
+  return result;
+}
+
+template <typename T>
+bool AtomicSharedPtr<T>::compare_exchange_strong(SharedPtr<T>& expected,
+                                                 SharedPtr<T> desired) {
+  Node* replacement = nullptr;
+  while (true) {
+    Node* node = node_of(acquire());
+    SharedPtr<T> current;
+    if (node) {
+      current = node->value;
+    }
+    if (!same(current, expected)) {
+      release(node);
+      delete replacement;
+      expected = std::move(current);
+      return false;
+    }
+    if (!replacement) {
+      replacement = make_node(desired);
+    }
+    uint64_t word = word_.load(std::memory_order_relaxed);
+    while (node_of(word) == node) {
+      if (word_.compare_exchange_weak(word, pack(replacement, 0),
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_relaxed)) {
+        // The swapped-out count includes this thread's own hold.
+        retire(node, count_of(word) - 1);
+        return true;
+      }
+    }
+    release(node);
+  }
+}
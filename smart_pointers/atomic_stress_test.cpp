@@ -0,0 +1,120 @@
+// Reader/writer stress test of AtomicSharedPtr.
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/atomic_stress_test.cpp -o atomic_stress_test
+// Best run again with -fsanitize=thread and -fsanitize=address.
+// Readers load() snapshots while writers replace the published object with
+// store, exchange and compare_exchange_strong. Every snapshot must be alive
+// while it is held, every object must be destroyed exactly once, and the
+// final value must be the last one a writer published. Exits with a non-zero
+// status on the first error.
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "atomic_shared_ptr.hpp"
+
+namespace {
+const int kReaderCount = 3;
+const int kWriterCount = 3;
+const int kWritesPerWriter = 20000;
+
+std::atomic<int> constructed = 0;
+std::atomic<int> destroyed = 0;
+std::atomic<bool> failed = false;
+
+struct Snapshot {
+  int writer;
+  int sequence;
+  std::atomic<bool> alive = true;
+
+  Snapshot(int writer, int sequence) : writer(writer), sequence(sequence) {
+    constructed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  ~Snapshot() {
+    if (!alive.exchange(false)) {
+      failed = true;
+    }
+    destroyed.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+void Check(bool condition, const char* what) {
+  if (!condition && !failed.exchange(true)) {
+    std::cerr << what << "\n";
+  }
+}
+
+// Each writer cycles through the three ways of publishing. A failed
+// compare_exchange hands back the current value and is retried with it.
+void Write(AtomicSharedPtr<Snapshot>& published, int writer) {
+  for (int sequence = 0; sequence < kWritesPerWriter; ++sequence) {
+    SharedPtr<Snapshot> next = MakeShared<Snapshot>(writer, sequence);
+    switch (sequence % 3) {
+      case 0:
+        published.store(next);
+        break;
+      case 1: {
+        SharedPtr<Snapshot> previous = published.exchange(next);
+        Check(previous.get() == nullptr || previous->alive.load(),
+              "exchange returned a destroyed object");
+        break;
+      }
+      default: {
+        SharedPtr<Snapshot> expected = published.load();
+        while (!published.compare_exchange_strong(expected, next)) {
+          Check(expected.get() == nullptr || expected->alive.load(),
+                "compare_exchange returned a destroyed object");
+        }
+      }
+    }
+    Check(next->alive.load(), "published object destroyed too early");
+  }
+}
+
+// Snapshots from one writer must never go back in sequence.
+void Read(const AtomicSharedPtr<Snapshot>& published,
+          const std::atomic<int>& writers_left) {
+  std::vector<int> last_sequence(kWriterCount, -1);
+  while (writers_left.load(std::memory_order_relaxed) != 0) {
+    SharedPtr<Snapshot> snapshot = published.load();
+    if (snapshot.get() == nullptr) {
+      continue;
+    }
+    Check(snapshot->alive.load(), "load returned a destroyed object");
+    int& last = last_sequence[snapshot->writer];
+    Check(snapshot->sequence >= last, "load went back in time");
+    last = snapshot->sequence;
+  }
+}
+}  // namespace
+
+int main() {
+  {
+    AtomicSharedPtr<Snapshot> published;
+    std::atomic<int> writers_left = kWriterCount;
+    std::vector<std::thread> threads;
+    for (int reader = 0; reader < kReaderCount; ++reader) {
+      threads.emplace_back([&] { Read(published, writers_left); });
+    }
+    for (int writer = 0; writer < kWriterCount; ++writer) {
+      threads.emplace_back([&, writer] {
+        Write(published, writer);
+        writers_left.fetch_sub(1, std::memory_order_relaxed);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    SharedPtr<Snapshot> last = published.load();
+    Check(last.get() != nullptr && last->sequence == kWritesPerWriter - 1,
+          "final value is not a writer's last write");
+    Check(last.use_count() == 2, "published value leaked a reference");
+  }
+  Check(constructed.load() == destroyed.load(), "snapshots leaked");
+  if (failed.load()) {
+    return 1;
+  }
+  std::cout << constructed.load() << " snapshots destroyed exactly once\n";
+  return 0;
+}
@@ -1,107 +1,625 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <typeinfo>
 #include <utility>
 #include <memory>
+#include <vector>
 
-template <typename T>
+#if defined(__linux__) && __has_include(<linux/membarrier.h>)
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define SMART_POINTERS_HEAVY_FENCE 1
+#else
+#define SMART_POINTERS_HEAVY_FENCE 0
+#endif
+
+// kLocal blocks are never shared between threads, so their counts are
+// updated with plain loads and stores instead of locked instructions.
+// kBiased blocks give their owner thread a plain count of its own and only
+// other threads pay for atomics; see BiasedControlBlock.
+enum class RefCountPolicy : unsigned char { kAtomic, kLocal, kBiased };
+
+namespace refcount {
+inline void increment(std::atomic<size_t>& count, RefCountPolicy policy) {
+  if (policy == RefCountPolicy::kLocal) {
+    count.store(count.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  } else {
+    count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+// Fails once the count has reached zero, so an expired owner is never revived.
+inline bool increment_if_nonzero(std::atomic<size_t>& count,
+                                 RefCountPolicy policy) {
+  size_t value = count.load(std::memory_order_relaxed);
+  if (policy == RefCountPolicy::kLocal) {
+    if (value != 0) {
+      count.store(value + 1, std::memory_order_relaxed);
+    }
+    return value != 0;
+  }
+  while (value != 0) {
+    if (count.compare_exchange_weak(value, value + 1,
+                                    std::memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if the count dropped to zero.
+inline bool decrement(std::atomic<size_t>& count, RefCountPolicy policy) {
+  if (policy == RefCountPolicy::kLocal) {
+    size_t value = count.load(std::memory_order_relaxed) - 1;
+    count.store(value, std::memory_order_relaxed);
+    return value == 0;
+  }
+  return count.fetch_sub(1, std::memory_order_acq_rel) == 1;
+}
+}  // namespace refcount
+
+// Build with -DSMART_POINTERS_INSTRUMENTATION to count live control blocks,
+// their peak and the allocations of every concrete block type. Without it
+// the hooks compile to nothing.
+#ifdef SMART_POINTERS_INSTRUMENTATION
+inline constexpr bool kInstrumented = true;
+#else
+inline constexpr bool kInstrumented = false;
+#endif
+
+namespace instrumentation {
+struct TypeStats {
+  const char* name;
+  std::atomic<uint64_t> allocations = 0;
+  TypeStats* next = nullptr;
+};
+
+inline std::atomic<size_t> live_blocks = 0;
+inline std::atomic<size_t> peak_blocks = 0;
+inline std::atomic<TypeStats*> registered_types = nullptr;
+
+template <typename Block>
+TypeStats& stats_for() {
+  static TypeStats* stats = [] {
+    auto* created = new TypeStats{typeid(Block).name()};
+    created->next = registered_types.load(std::memory_order_relaxed);
+    while (!registered_types.compare_exchange_weak(
+        created->next, created, std::memory_order_release,
+        std::memory_order_relaxed)) {
+    }
+    return created;
+  }();
+  return *stats;
+}
+
+template <typename Block>
+void on_create() {
+  if constexpr (kInstrumented) {
+    stats_for<Block>().allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t live = live_blocks.fetch_add(1, std::memory_order_relaxed) + 1;
+    size_t peak = peak_blocks.load(std::memory_order_relaxed);
+    while (peak < live && !peak_blocks.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+  }
+}
+
+inline void on_destroy() {
+  if constexpr (kInstrumented) {
+    live_blocks.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+// Calls visitor(name, allocations) for every block type created so far.
+template <typename Visitor>
+void for_each_type(Visitor visitor) {
+  for (TypeStats* stats = registered_types.load(std::memory_order_acquire);
+       stats; stats = stats->next) {
+    visitor(stats->name, stats->allocations.load(std::memory_order_relaxed));
+  }
+}
+
+inline void reset_peak() {
+  peak_blocks.store(live_blocks.load(std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+}
+}  // namespace instrumentation
+
+// Biased counting lets the owner thread update its count with plain loads and
+// stores, so another thread that needs that count must make the owner's
+// stores visible from outside. heavy_fence() runs a full barrier on every
+// CPU currently executing a thread of this process (membarrier), which pairs
+// with compiler-only ordering on the owner's side. Where it is unavailable
+// MakeBiasedShared falls back to atomic counts.
+namespace biased {
+struct Owner {
+  std::atomic<bool> busy = false;
+};
+
+#if SMART_POINTERS_HEAVY_FENCE
+inline bool heavy_fence_available() {
+  static const bool registered =
+      syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0,
+              0) == 0;
+  return registered;
+}
+
+inline void heavy_fence() {
+  syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+}
+#else
+inline bool heavy_fence_available() { return false; }
+
+inline void heavy_fence() {}
+#endif
+
+// Owner records are never freed. The record of an exited thread is handed to
+// the next thread that needs one, which then also owns the exited thread's
+// blocks; only one thread at a time ever updates their biased counts.
+struct OwnerRegistry {
+  std::mutex mutex;
+  std::vector<Owner*> orphans;
+
+  static OwnerRegistry& instance() {
+    static OwnerRegistry* registry = new OwnerRegistry;
+    return *registry;
+  }
+
+  Owner* adopt() {
+    std::lock_guard lock(mutex);
+    if (orphans.empty()) {
+      return new Owner;
+    }
+    Owner* owner = orphans.back();
+    orphans.pop_back();
+    return owner;
+  }
+
+  void orphan(Owner* owner) {
+    std::lock_guard lock(mutex);
+    orphans.push_back(owner);
+  }
+};
+
+inline thread_local Owner* tls_owner = nullptr;
+inline thread_local bool tls_owner_exited = false;
+
+struct OwnerReaper {
+  ~OwnerReaper() {
+    OwnerRegistry::instance().orphan(tls_owner);
+    tls_owner = nullptr;
+    tls_owner_exited = true;
+  }
+};
+
+// Null once the thread is exiting.
+inline Owner* current_owner() {
+  if (!tls_owner && !tls_owner_exited) {
+    tls_owner = OwnerRegistry::instance().adopt();
+    thread_local OwnerReaper reaper;
+    (void)reaper;
+  }
+  return tls_owner;
+}
+}  // namespace biased
+
+// weak_count holds one extra reference on behalf of all shared owners, so
+// exactly one thread sees it reach zero and frees the block.
+//
+// The block is not templated on the pointee: each concrete block passes a
+// single manager function that destroys the object or frees the block, so
+// releasing needs no vtable and upcasting a SharedPtr needs no cast.
 struct BaseControlBlock {
-  T* ptr = nullptr;
-  size_t shared_count = 1;
-  size_t weak_count = 0;
+  enum class Operation : unsigned char { kDestroyObject, kDeallocate };
+  using Manager = void (*)(BaseControlBlock*, Operation);
+
+  std::atomic<size_t> shared_count = 1;
+  std::atomic<size_t> weak_count = 1;
+  RefCountPolicy policy = RefCountPolicy::kAtomic;
+  Manager manager;
+
+  explicit BaseControlBlock(Manager manager) : manager(manager) {}
 
-  BaseControlBlock(T* ptr, size_t shared_count = 1, size_t weak_count = 0)
-      : ptr(ptr), shared_count(shared_count), weak_count(weak_count) {};
+  size_t use_count() const;
 
-  operator bool() const { return ptr != nullptr; }
+  void add_shared();
 
-  void add_shared() { ++shared_count; }
+  bool try_add_shared();
 
-  void add_weak() { ++weak_count; }
+  void add_weak() { refcount::increment(weak_count, policy); }
 
   void release_shared();
 
-  void release_weak();
+  void release_weak() {
+    if (refcount::decrement(weak_count, policy)) {
+      instrumentation::on_destroy();
+      manager(this, Operation::kDeallocate);
+    }
+  }
+
+ protected:
+  void destroy_object() {
+    manager(this, Operation::kDestroyObject);
+    release_weak();
+  }
+};
+
+// Base of MakeBiasedShared blocks; only they carry the owner's count. The
+// owner thread keeps its references in biased_count, and shared_count counts
+// the other threads' references in units of kSharedUnit. shared_count never
+// goes below zero: a thread whose release would take it there steals the
+// biased count instead. It raises kStealing and `stolen`, runs the heavy
+// fence, waits until the owner is outside an update and folds the biased
+// count into shared_count together with kMerged. The owner merges by itself
+// when its count reaches zero. A merged block is counted like a kAtomic one,
+// and an unmerged block always has a live reference, so lock() succeeds
+// exactly while use_count() is non-zero and dead objects are freed at once.
+struct BiasedControlBlock : BaseControlBlock {
+  static constexpr size_t kMerged = 1;
+  static constexpr size_t kStealing = 2;
+  static constexpr size_t kSharedUnit = 4;
 
-  virtual void no_shared();
+  biased::Owner* owner = nullptr;
+  std::atomic<size_t> biased_count = 0;
+  std::atomic<bool> stolen = false;
 
-  virtual void no_weak_and_shared() { operator delete(this); };
+  explicit BiasedControlBlock(Manager manager) : BaseControlBlock(manager) {}
 
-  virtual ~BaseControlBlock() = default;
+  // Must be called before the block is visible to any other thread.
+  void bias_to_current_thread();
+
+  size_t use_count_biased() const;
+
+  void add_shared_biased();
+
+  bool try_add_shared_biased();
+
+  void release_shared_biased();
+
+ private:
+  static bool is_dead(size_t value) {
+    return (value & ~kStealing) == kMerged;
+  }
+
+  bool update_owned(bool increment);
+
+  void steal();
 };
 
-template <typename T>
-void BaseControlBlock<T>::no_shared() {
-  delete ptr;
-  ptr = nullptr;
+inline void BiasedControlBlock::bias_to_current_thread() {
+  owner = biased::current_owner();
+  if (!owner || !biased::heavy_fence_available()) {
+    return;
+  }
+  biased_count.store(shared_count.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+  shared_count.store(0, std::memory_order_relaxed);
+  policy = RefCountPolicy::kBiased;
+}
+
+inline size_t BiasedControlBlock::use_count_biased() const {
+  size_t value = shared_count.load(std::memory_order_relaxed);
+  if ((value & kMerged) != 0) {
+    return value / kSharedUnit;
+  }
+  return biased_count.load(std::memory_order_relaxed) + value / kSharedUnit;
+}
+
+// The owner's fast path. busy and the signal fences keep its accesses in
+// program order for the compiler; the CPU side is ordered by the stealer's
+// heavy fence. Returns false when the caller has to use shared_count.
+inline bool BiasedControlBlock::update_owned(bool increment) {
+  if (owner != biased::tls_owner) {
+    return false;
+  }
+  owner->busy.store(true, std::memory_order_relaxed);
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  size_t biased = biased_count.load(std::memory_order_relaxed);
+  if (biased == 0 || stolen.load(std::memory_order_relaxed)) {
+    owner->busy.store(false, std::memory_order_release);
+    return false;
+  }
+  biased = increment ? biased + 1 : biased - 1;
+  biased_count.store(biased, std::memory_order_relaxed);
+  size_t value = 0;
+  if (biased == 0) {
+    value = shared_count.fetch_add(kMerged, std::memory_order_acq_rel) +
+            kMerged;
+  }
+  owner->busy.store(false, std::memory_order_release);
+  if (biased == 0 && is_dead(value)) {
+    destroy_object();
+  }
+  return true;
 }
 
-template <typename T>
-void BaseControlBlock<T>::release_weak() {
-  --weak_count;
-  if ((weak_count == 0) && (shared_count == 0)) {
-    no_weak_and_shared();
+// Called with kStealing set by this thread, while it still holds a reference
+// that is counted in biased_count.
+inline void BiasedControlBlock::steal() {
+  stolen.store(true, std::memory_order_relaxed);
+  biased::heavy_fence();
+  while (owner->busy.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  size_t delta = size_t(0) - kStealing;
+  if ((shared_count.load(std::memory_order_acquire) & kMerged) == 0) {
+    delta += biased_count.load(std::memory_order_relaxed) * kSharedUnit +
+             kMerged;
   }
+  shared_count.fetch_add(delta, std::memory_order_acq_rel);
 }
 
-template <typename T>
-void BaseControlBlock<T>::release_shared() {
-  --shared_count;
-  if (shared_count == 0) {
-    no_shared();
-    if (weak_count == 0) {
-      no_weak_and_shared();
+// The entry points stay out of line: inlined next to a smaller block, GCC
+// warns about the BiasedControlBlock fields its policy check never reaches.
+[[gnu::noinline]] inline void BiasedControlBlock::add_shared_biased() {
+  if (!update_owned(true)) {
+    shared_count.fetch_add(kSharedUnit, std::memory_order_relaxed);
+  }
+}
+
+[[gnu::noinline]] inline bool BiasedControlBlock::try_add_shared_biased() {
+  if (update_owned(true)) {
+    return true;
+  }
+  size_t value = shared_count.load(std::memory_order_relaxed);
+  while (!is_dead(value)) {
+    if (shared_count.compare_exchange_weak(value, value + kSharedUnit,
+                                           std::memory_order_relaxed)) {
+      return true;
     }
   }
+  return false;
+}
+
+[[gnu::noinline]] inline void BiasedControlBlock::release_shared_biased() {
+  if (update_owned(false)) {
+    return;
+  }
+  size_t value = shared_count.load(std::memory_order_relaxed);
+  while (true) {
+    if ((value & kMerged) == 0 && value < kSharedUnit) {
+      if ((value & kStealing) != 0) {
+        std::this_thread::yield();
+        value = shared_count.load(std::memory_order_relaxed);
+      } else if (shared_count.compare_exchange_weak(
+                     value, value | kStealing, std::memory_order_relaxed)) {
+        steal();
+        value = shared_count.load(std::memory_order_relaxed);
+      }
+      continue;
+    }
+    if (shared_count.compare_exchange_weak(value, value - kSharedUnit,
+                                           std::memory_order_acq_rel,
+                                           std::memory_order_relaxed)) {
+      if (is_dead(value - kSharedUnit)) {
+        destroy_object();
+      }
+      return;
+    }
+  }
+}
+
+inline size_t BaseControlBlock::use_count() const {
+  if (policy == RefCountPolicy::kBiased) {
+    return static_cast<const BiasedControlBlock*>(this)->use_count_biased();
+  }
+  return shared_count.load(std::memory_order_relaxed);
+}
+
+inline void BaseControlBlock::add_shared() {
+  if (policy == RefCountPolicy::kBiased) {
+    static_cast<BiasedControlBlock*>(this)->add_shared_biased();
+  } else {
+    refcount::increment(shared_count, policy);
+  }
+}
+
+inline bool BaseControlBlock::try_add_shared() {
+  if (policy == RefCountPolicy::kBiased) {
+    return static_cast<BiasedControlBlock*>(this)->try_add_shared_biased();
+  }
+  return refcount::increment_if_nonzero(shared_count, policy);
+}
+
+inline void BaseControlBlock::release_shared() {
+  if (policy == RefCountPolicy::kBiased) {
+    static_cast<BiasedControlBlock*>(this)->release_shared_biased();
+  } else if (refcount::decrement(shared_count, policy)) {
+    destroy_object();
+  }
 }
 
 template <typename T, typename Deleter = std::default_delete<T>,
     typename Allocator = std::allocator<T>>
-struct AllocatorControlBlock : BaseControlBlock<T> {
+struct AllocatorControlBlock : BaseControlBlock {
+  T* ptr;
   [[no_unique_address]] Deleter deleter;
   [[no_unique_address]] Allocator allocator;
 
-  void no_shared() override {
-    deleter(BaseControlBlock<T>::ptr);
-    BaseControlBlock<T>::ptr = nullptr;
-  }
-
-  void no_weak_and_shared() override {
+  static void manage(BaseControlBlock* block, Operation operation) {
+    auto* self = static_cast<AllocatorControlBlock*>(block);
+    if (operation == Operation::kDestroyObject) {
+      self->deleter(self->ptr);
+      return;
+    }
     using BlockAlloc = std::allocator_traits<Allocator>::
         template rebind_alloc<AllocatorControlBlock>;
-    BlockAlloc block_allocator(allocator);
-    std::allocator_traits<decltype(block_allocator)>::destroy(block_allocator, this);
-    std::allocator_traits<decltype(block_allocator)>::deallocate(block_allocator, this, 1);
+    BlockAlloc block_allocator(self->allocator);
+    std::allocator_traits<BlockAlloc>::destroy(block_allocator, self);
+    std::allocator_traits<BlockAlloc>::deallocate(block_allocator, self, 1);
   }
 
-  AllocatorControlBlock(T* ptr, Deleter deleter = std::default_delete<T>(),
-                        Allocator allocator = std::allocator<T>())
-      :  deleter(deleter), allocator(allocator), BaseControlBlock<T>(ptr) {};
+  AllocatorControlBlock(T* ptr, Deleter deleter = Deleter(),
+                        Allocator allocator = Allocator())
+      : BaseControlBlock(&manage),
+        ptr(ptr),
+        deleter(deleter),
+        allocator(allocator) {
+    instrumentation::on_create<AllocatorControlBlock>();
+  }
 };
 
+// The object lives in a union so that its lifetime ends when the last
+// SharedPtr goes away, while the block itself stays until the last WeakPtr.
+// Base is BiasedControlBlock for MakeBiasedShared.
+template <typename T, typename Allocator, typename Base = BaseControlBlock>
+struct AllocateSharedControlBlock : Base {
+  using Operation = BaseControlBlock::Operation;
+  using BlockAlloc = std::allocator_traits<Allocator>::template rebind_alloc<
+      AllocateSharedControlBlock>;
+
+  [[no_unique_address]] Allocator allocator;
+  union {
+    T object;
+  };
+
+  template <typename... Args>
+  static AllocateSharedControlBlock* create(const Allocator& allocator,
+                                            Args&&... args);
+
+  static void manage(BaseControlBlock* block, Operation operation) {
+    auto* self = static_cast<AllocateSharedControlBlock*>(block);
+    if (operation == Operation::kDestroyObject) {
+      std::allocator_traits<Allocator>::destroy(self->allocator, &self->object);
+      return;
+    }
+    BlockAlloc block_allocator(self->allocator);
+    std::allocator_traits<BlockAlloc>::destroy(block_allocator, self);
+    std::allocator_traits<BlockAlloc>::deallocate(block_allocator, self, 1);
+  }
+
+  template <typename... Args>
+  AllocateSharedControlBlock(const Allocator& allocator, Args&&... args)
+      : Base(&manage), allocator(allocator) {
+    std::allocator_traits<Allocator>::construct(
+        this->allocator, &object, std::forward<Args>(args)...);
+    instrumentation::on_create<AllocateSharedControlBlock>();
+  }
+
+  ~AllocateSharedControlBlock() {}
+};
+
+template <typename T, typename Allocator, typename Base>
+template <typename... Args>
+AllocateSharedControlBlock<T, Allocator, Base>*
+AllocateSharedControlBlock<T, Allocator, Base>::create(
+    const Allocator& allocator, Args&&... args) {
+  BlockAlloc block_allocator(allocator);
+  using BlockTraits = std::allocator_traits<BlockAlloc>;
+  auto* block = BlockTraits::allocate(block_allocator, 1);
+  try {
+    BlockTraits::construct(block_allocator, block, allocator,
+                           std::forward<Args>(args)...);
+  } catch (...) {
+    BlockTraits::deallocate(block_allocator, block, 1);
+    throw;
+  }
+  return block;
+}
+
+template <size_t kAlignment>
+struct alignas(kAlignment) AlignedUnit {
+  unsigned char bytes[kAlignment];
+};
+
+// Header of a MakeShared<T[]> allocation: the elements follow the block in
+// the same storage, which is allocated as a run of aligned units.
 template <typename T, typename Allocator>
-struct AllocateSharedControlBlock :
-    AllocatorControlBlock<T,std::default_delete<T>, Allocator> {
-  using BaseClass = AllocatorControlBlock<T, std::default_delete<T>,
-                                          Allocator>;
+struct ArrayControlBlock : BaseControlBlock {
+  [[no_unique_address]] Allocator allocator;
+  size_t size;
 
-  T object;
+  ArrayControlBlock(const Allocator& allocator, size_t size)
+      : BaseControlBlock(&manage), allocator(allocator), size(size) {
+    instrumentation::on_create<ArrayControlBlock>();
+  }
 
-  void no_shared() override {
-    using traits = std::allocator_traits<decltype(BaseClass::allocator)>;
-    traits::destroy(BaseClass::allocator, &object);
-    BaseControlBlock<T>::ptr = nullptr;
+  T* elements() {
+    return reinterpret_cast<T*>(reinterpret_cast<char*>(this) +
+                                elements_offset());
   }
 
-  void no_weak_and_shared() override {
-    using BlockAlloc = std::allocator_traits<Allocator>::
-        template rebind_alloc<AllocateSharedControlBlock>;
-    BlockAlloc block_allocator(BaseClass::allocator);
-    std::allocator_traits<
-        decltype(block_allocator)>::deallocate(block_allocator,this, 1);
+  static ArrayControlBlock* create(const Allocator& allocator, size_t size);
+
+  static void manage(BaseControlBlock* block, Operation operation);
+
+ private:
+  using Unit = AlignedUnit<std::max(alignof(T), alignof(BaseControlBlock))>;
+  using UnitAlloc =
+      std::allocator_traits<Allocator>::template rebind_alloc<Unit>;
+  using ElementAlloc =
+      std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+  static constexpr size_t elements_offset() {
+    return (sizeof(ArrayControlBlock) + alignof(T) - 1) / alignof(T) *
+           alignof(T);
   }
 
-  template <typename... Args>
-  AllocateSharedControlBlock(Allocator allocator, Args&&... args)
-      : object(std::forward<Args>(args)...),
-        BaseClass(&object, std::default_delete<T>(), allocator) {}
+  static size_t unit_count(size_t size) {
+    if (size > (SIZE_MAX - elements_offset() - sizeof(Unit)) / sizeof(T)) {
+      throw std::bad_array_new_length();
+    }
+    return (elements_offset() + size * sizeof(T) + sizeof(Unit) - 1) /
+           sizeof(Unit);
+  }
 };
 
+template <typename T, typename Allocator>
+ArrayControlBlock<T, Allocator>* ArrayControlBlock<T, Allocator>::create(
+    const Allocator& allocator, size_t size) {
+  static_assert(alignof(ArrayControlBlock) <= alignof(Unit));
+  UnitAlloc unit_allocator(allocator);
+  size_t units = unit_count(size);
+  Unit* storage = std::allocator_traits<UnitAlloc>::allocate(unit_allocator,
+                                                             units);
+  auto* block = std::construct_at(reinterpret_cast<ArrayControlBlock*>(storage),
+                                  allocator, size);
+  ElementAlloc element_allocator(allocator);
+  T* elements = block->elements();
+  size_t constructed = 0;
+  try {
+    for (; constructed < size; ++constructed) {
+      std::allocator_traits<ElementAlloc>::construct(element_allocator,
+                                                     elements + constructed);
+    }
+  } catch (...) {
+    while (constructed != 0) {
+      std::allocator_traits<ElementAlloc>::destroy(element_allocator,
+                                                   elements + --constructed);
+    }
+    instrumentation::on_destroy();
+    std::destroy_at(block);
+    std::allocator_traits<UnitAlloc>::deallocate(unit_allocator, storage,
+                                                 units);
+    throw;
+  }
+  return block;
+}
+
+template <typename T, typename Allocator>
+void ArrayControlBlock<T, Allocator>::manage(BaseControlBlock* block,
+                                             Operation operation) {
+  auto* self = static_cast<ArrayControlBlock*>(block);
+  if (operation == Operation::kDestroyObject) {
+    ElementAlloc element_allocator(self->allocator);
+    T* elements = self->elements();
+    for (size_t i = self->size; i != 0; --i) {
+      std::allocator_traits<ElementAlloc>::destroy(element_allocator,
+                                                   elements + i - 1);
+    }
+    return;
+  }
+  UnitAlloc unit_allocator(self->allocator);
+  size_t units = unit_count(self->size);
+  std::destroy_at(self);
+  std::allocator_traits<UnitAlloc>::deallocate(
+      unit_allocator, reinterpret_cast<Unit*>(self), units);
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Background reclamation queue. Objects retired by DeferredDelete join the
+// open epoch; a worker thread closes an epoch once it has collected
+// kBatchSize objects, kEpochInterval has passed, or someone flushes, and runs
+// the destructors of the whole batch outside the lock.
+//
+// The instance is never destroyed, so SharedPtrs in statics can retire into
+// it at any point of shutdown; call drain() where pending objects have to be
+// destroyed before the process exits.
+class Reclaimer {
+ public:
+  static constexpr std::chrono::milliseconds kEpochInterval{1};
+  static constexpr size_t kBatchSize = 1024;
+
+  static Reclaimer& instance() {
+    static Reclaimer* reclaimer = new Reclaimer;
+    return *reclaimer;
+  }
+
+  // After drain() the destructor runs inline on the calling thread.
+  void retire(std::function<void()> destroy);
+
+  // Blocks until everything retired before the call has been destroyed.
+  void flush();
+
+  // Destroys everything pending and stops the worker; meant for shutdown.
+  void drain();
+
+  size_t queue_depth() const {
+    return queue_depth_.load(std::memory_order_relaxed);
+  }
+
+  size_t peak_queue_depth() const {
+    return peak_queue_depth_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t reclaimed() const {
+    return reclaimed_.load(std::memory_order_relaxed);
+  }
+
+  uint64_t epoch() const {
+    return reclaimed_epoch_.load(std::memory_order_relaxed);
+  }
+
+  ~Reclaimer() { drain(); }
+
+ private:
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+  std::vector<std::function<void()>> pending_;
+  std::thread worker_;
+  bool stopping_ = false;
+  bool flush_requested_ = false;
+  uint64_t open_epoch_ = 0;
+  std::atomic<uint64_t> reclaimed_epoch_ = 0;
+  std::atomic<size_t> queue_depth_ = 0;
+  std::atomic<size_t> peak_queue_depth_ = 0;
+  std::atomic<uint64_t> reclaimed_ = 0;
+};
+
+inline void Reclaimer::retire(std::function<void()> destroy) {
+  std::unique_lock lock(mutex_);
+  if (stopping_) {
+    lock.unlock();
+    destroy();
+    return;
+  }
+  if (!worker_.joinable()) {
+    worker_ = std::thread([this] { run(); });
+  }
+  pending_.push_back(std::move(destroy));
+  // A worker asleep on an empty queue has to start timing the new epoch.
+  if (pending_.size() == 1 || pending_.size() >= kBatchSize) {
+    wake_.notify_one();
+  }
+  size_t depth = queue_depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t peak = peak_queue_depth_.load(std::memory_order_relaxed);
+  while (peak < depth && !peak_queue_depth_.compare_exchange_weak(
+                             peak, depth, std::memory_order_relaxed)) {
+  }
+}
+
+inline void Reclaimer::flush() {
+  std::unique_lock lock(mutex_);
+  if (!worker_.joinable()) {
+    return;
+  }
+  uint64_t target = open_epoch_ + 1;
+  flush_requested_ = true;
+  wake_.notify_one();
+  done_.wait(lock, [&] {
+    return reclaimed_epoch_.load(std::memory_order_relaxed) >= target;
+  });
+}
+
+inline void Reclaimer::drain() {
+  std::thread worker;
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+    worker = std::move(worker_);
+  }
+  wake_.notify_one();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+inline void Reclaimer::run() {
+  std::vector<std::function<void()>> batch;
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_.wait(lock, [&] {
+      return stopping_ || flush_requested_ || !pending_.empty();
+    });
+    if (!stopping_ && !flush_requested_) {
+      wake_.wait_for(lock, kEpochInterval, [&] {
+        return stopping_ || flush_requested_ || pending_.size() >= kBatchSize;
+      });
+    }
+    if (pending_.empty() && !flush_requested_) {
+      break;
+    }
+    batch.swap(pending_);
+    flush_requested_ = false;
+    uint64_t closed = open_epoch_++;
+    lock.unlock();
+    for (auto& destroy : batch) {
+      destroy();
+      queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    reclaimed_.fetch_add(batch.size(), std::memory_order_relaxed);
+    batch.clear();
+    lock.lock();
+    reclaimed_epoch_.store(closed + 1, std::memory_order_relaxed);
+    done_.notify_all();
+  }
+}
+
+// Deleter policy for AllocatorControlBlock: the last SharedPtr hands the
+// object to the reclaimer instead of destroying it on the releasing thread.
+//   SharedPtr<Graph> graph(new Graph, DeferredDelete<Graph>());
+// MakeShared objects live inside their control block and are still
+// destroyed inline.
+template <typename T, typename Deleter = std::default_delete<T>>
+struct DeferredDelete {
+  [[no_unique_address]] Deleter deleter;
+
+  void operator()(T* ptr) const {
+    Reclaimer::instance().retire(
+        [deleter = deleter, ptr]() mutable { deleter(ptr); });
+  }
+};
@@ -0,0 +1,320 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "smart_pointers.hpp"
+
+// Weak references to a RefCounted object go through this block. Once it
+// exists it holds the strong count instead of the object, and weak_count
+// carries one extra reference on behalf of all strong owners.
+struct IntrusiveSideBlock {
+  std::atomic<size_t> strong_count;
+  std::atomic<size_t> weak_count = 1;
+
+  explicit IntrusiveSideBlock(size_t strong_count)
+      : strong_count(strong_count) {}
+
+  bool try_add_strong() {
+    size_t count = strong_count.load(std::memory_order_relaxed);
+    while (count != 0) {
+      if (strong_count.compare_exchange_weak(count, count + 1,
+                                             std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void add_weak() { weak_count.fetch_add(1, std::memory_order_relaxed); }
+
+  void release_weak() {
+    if (weak_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+};
+
+// Mixin that stores the reference count inside the object:
+//   struct Node : RefCounted<Node> { ... };
+// With kWeakable the object can also be observed by IntrusiveWeakPtr. Its
+// count word then either holds the count shifted left by one, or, once the
+// first weak reference is taken, a pointer to an IntrusiveSideBlock tagged
+// with the low bit.
+template <typename Derived, bool kWeakable = false>
+class RefCounted {
+ public:
+  RefCounted() = default;
+
+  RefCounted(const RefCounted&) {}
+
+  RefCounted& operator=(const RefCounted&) { return *this; }
+
+  size_t use_count() const;
+
+ protected:
+  ~RefCounted() = default;
+
+ private:
+  static constexpr uintptr_t kSideTag = 1;
+  static constexpr uintptr_t kCountUnit = kWeakable ? 2 : 1;
+
+  static IntrusiveSideBlock* side_of(uintptr_t word) {
+    return reinterpret_cast<IntrusiveSideBlock*>(word & ~kSideTag);
+  }
+
+  static bool is_side(uintptr_t word) {
+    return kWeakable && (word & kSideTag) != 0;
+  }
+
+  void add_ref() const;
+
+  void release() const;
+
+  IntrusiveSideBlock* side_block() const;
+
+  friend void intrusive_add_ref(const RefCounted* object) {
+    object->add_ref();
+  }
+
+  friend void intrusive_release(const RefCounted* object) {
+    object->release();
+  }
+
+  friend IntrusiveSideBlock* intrusive_side_block(const RefCounted* object)
+    requires kWeakable
+  {
+    return object->side_block();
+  }
+
+  mutable std::atomic<uintptr_t> word_ = 0;
+};
+
+template <typename Derived, bool kWeakable>
+size_t RefCounted<Derived, kWeakable>::use_count() const {
+  uintptr_t word = word_.load(std::memory_order_acquire);
+  if (is_side(word)) {
+    return side_of(word)->strong_count.load(std::memory_order_relaxed);
+  }
+  return word / kCountUnit;
+}
+
+template <typename Derived, bool kWeakable>
+void RefCounted<Derived, kWeakable>::add_ref() const {
+  if constexpr (!kWeakable) {
+    word_.fetch_add(kCountUnit, std::memory_order_relaxed);
+  } else {
+    uintptr_t word = word_.load(std::memory_order_acquire);
+    while (!is_side(word)) {
+      if (word_.compare_exchange_weak(word, word + kCountUnit,
+                                      std::memory_order_acquire)) {
+        return;
+      }
+    }
+    side_of(word)->strong_count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+template <typename Derived, bool kWeakable>
+void RefCounted<Derived, kWeakable>::release() const {
+  auto* object = static_cast<const Derived*>(this);
+  if constexpr (!kWeakable) {
+    if (word_.fetch_sub(kCountUnit, std::memory_order_acq_rel) == kCountUnit) {
+      delete object;
+    }
+  } else {
+    uintptr_t word = word_.load(std::memory_order_acquire);
+    while (!is_side(word)) {
+      if (word_.compare_exchange_weak(word, word - kCountUnit,
+                                      std::memory_order_acq_rel,
+                                      std::memory_order_acquire)) {
+        if (word == kCountUnit) {
+          delete object;
+        }
+        return;
+      }
+    }
+    IntrusiveSideBlock* side = side_of(word);
+    if (side->strong_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete object;
+      side->release_weak();
+    }
+  }
+}
+
+// Called while the caller holds a strong reference, so the object is alive.
+template <typename Derived, bool kWeakable>
+IntrusiveSideBlock* RefCounted<Derived, kWeakable>::side_block() const {
+  uintptr_t word = word_.load(std::memory_order_acquire);
+  IntrusiveSideBlock* side = nullptr;
+  while (!is_side(word)) {
+    if (!side) {
+      side = new IntrusiveSideBlock(word / kCountUnit);
+    } else {
+      side->strong_count.store(word / kCountUnit, std::memory_order_relaxed);
+    }
+    if (word_.compare_exchange_weak(
+            word, reinterpret_cast<uintptr_t>(side) | kSideTag,
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+      return side;
+    }
+  }
+  delete side;
+  return side_of(word);
+}
+
+template <typename T>
+class IntrusivePtr {
+ public:
+  IntrusivePtr() = default;
+
+  IntrusivePtr(std::nullptr_t){};
+
+  // Takes a new reference, so a raw pointer to an object that is already
+  // owned (for example `this`) can be turned back into an IntrusivePtr.
+  explicit IntrusivePtr(T* ptr) : ptr_(ptr) {
+    if (ptr_) {
+      intrusive_add_ref(ptr_);
+    }
+  }
+
+  IntrusivePtr(const IntrusivePtr& other) : IntrusivePtr(other.ptr_) {}
+
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  IntrusivePtr(const IntrusivePtr<Y>& other) : IntrusivePtr(other.ptr_) {}
+
+  IntrusivePtr(IntrusivePtr&& other) : ptr_(other.ptr_) {
+    other.ptr_ = nullptr;
+  }
+
+  template <typename Y>
+    requires std::is_convertible_v<Y*, T*>
+  IntrusivePtr(IntrusivePtr<Y>&& other) : ptr_(other.ptr_) {
+    other.ptr_ = nullptr;
+  }
+
+  IntrusivePtr& operator=(IntrusivePtr other) {
+    swap(other);
+    return *this;
+  }
+
+  T* get() const { return ptr_; };
+
+  T* operator->() const { return ptr_; };
+
+  T& operator*() const { return *ptr_; };
+
+  size_t use_count() const { return ptr_ ? ptr_->use_count() : 0; };
+
+  void swap(IntrusivePtr& other) { std::swap(ptr_, other.ptr_); }
+
+  void reset() { IntrusivePtr().swap(*this); };
+
+  ~IntrusivePtr() {
+    if (ptr_) {
+      intrusive_release(ptr_);
+    }
+  }
+
+ private:
+  struct Adopt {};
+
+  IntrusivePtr(T* ptr, Adopt) : ptr_(ptr) {}
+
+  template <typename X>
+  friend class IntrusivePtr;
+
+  template <typename U>
+  friend class IntrusiveWeakPtr;
+
+  T* ptr_ = nullptr;
+};
+
+template <typename T>
+class IntrusiveWeakPtr {
+ public:
+  IntrusiveWeakPtr() = default;
+
+  IntrusiveWeakPtr(const IntrusivePtr<T>& other) : ptr_(other.ptr_) {
+    if (ptr_) {
+      side_ = intrusive_side_block(ptr_);
+      side_->add_weak();
+    }
+  }
+
+  IntrusiveWeakPtr(const IntrusiveWeakPtr& other)
+      : ptr_(other.ptr_), side_(other.side_) {
+    if (side_) {
+      side_->add_weak();
+    }
+  }
+
+  IntrusiveWeakPtr(IntrusiveWeakPtr&& other)
+      : ptr_(other.ptr_), side_(other.side_) {
+    other.ptr_ = nullptr;
+    other.side_ = nullptr;
+  }
+
+  IntrusiveWeakPtr& operator=(IntrusiveWeakPtr other) {
+    swap(other);
+    return *this;
+  }
+
+  bool expired() const {
+    return !side_ || side_->strong_count.load(std::memory_order_relaxed) == 0;
+  }
+
+  IntrusivePtr<T> lock() const {
+    if (!side_ || !side_->try_add_strong()) {
+      return nullptr;
+    }
+    return IntrusivePtr<T>(ptr_, typename IntrusivePtr<T>::Adopt{});
+  }
+
+  void swap(IntrusiveWeakPtr& other) {
+    std::swap(ptr_, other.ptr_);
+    std::swap(side_, other.side_);
+  }
+
+  ~IntrusiveWeakPtr() {
+    if (side_) {
+      side_->release_weak();
+    }
+  }
+
+ private:
+  T* ptr_ = nullptr;
+  IntrusiveSideBlock* side_ = nullptr;
+};
+
+template <typename T, typename... Args>
+IntrusivePtr<T> MakeIntrusive(Args&&... args) {
+  return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
+}
+
+// The returned SharedPtr keeps one intrusive reference alive, so code that
+// only speaks SharedPtr can hold RefCounted objects. This costs one control
+// block per call; WeakPtrs made from the result expire with that SharedPtr
+// family, not with the object.
+template <typename T>
+SharedPtr<T> ToShared(const IntrusivePtr<T>& pointer) {
+  T* ptr = pointer.get();
+  if (!ptr) {
+    return nullptr;
+  }
+  intrusive_add_ref(ptr);
+  return SharedPtr<T>(ptr, [](T* object) { intrusive_release(object); });
+}
+
+// The way back from ToShared. Only an object whose lifetime is governed by
+// its intrusive count can get another intrusive owner; one that lives in a
+// SharedPtr control block (MakeShared, SharedPtr(new T)) has a zero count,
+// and an empty IntrusivePtr is returned for it. A SharedPtr made by ToShared
+// holds an intrusive reference itself, so its object always qualifies.
+template <typename T>
+IntrusivePtr<T> ToIntrusive(const SharedPtr<T>& pointer) {
+  T* ptr = pointer.get();
+  if (!ptr || ptr->use_count() == 0) {
+    return nullptr;
+  }
+  return IntrusivePtr<T>(ptr);
+}
@@ -0,0 +1,135 @@
+// Multithreaded stress test of IntrusivePtr and IntrusiveWeakPtr.
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/intrusive_stress_test.cpp -o intrusive_stress_test
+// Best run again with -fsanitize=thread and -fsanitize=address.
+// Threads race to take the first weak reference of a fresh object, so the
+// count word moves to its side block while others copy and release strong
+// references through IntrusivePtr and through ToShared/ToIntrusive. Lockers
+// race with the release of the last strong reference. Every object must be
+// destroyed exactly once and no lock() may return a destroyed object. Exits
+// with a non-zero status on the first error.
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "intrusive_ptr.hpp"
+
+namespace {
+const int kThreadCount = 4;
+const int kRounds = 2000;
+const int kCopiesPerRound = 64;
+
+std::atomic<int> constructed = 0;
+std::atomic<int> destroyed = 0;
+std::atomic<bool> failed = false;
+
+struct Node : RefCounted<Node, true> {
+  std::atomic<bool> alive = true;
+
+  Node() { constructed.fetch_add(1, std::memory_order_relaxed); }
+
+  ~Node() {
+    if (!alive.exchange(false)) {
+      failed = true;
+    }
+    destroyed.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+void Check(bool condition, const char* what) {
+  if (!condition && !failed.exchange(true)) {
+    std::cerr << what << "\n";
+  }
+}
+
+template <typename Work>
+void RunThreads(const Work& work) {
+  std::vector<std::thread> threads;
+  for (int thread_idx = 0; thread_idx < kThreadCount; ++thread_idx) {
+    threads.emplace_back(work, thread_idx);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+void WaitForAll(std::atomic<int>& ready) {
+  ready.fetch_add(1);
+  while (ready.load() != kThreadCount) {
+    std::this_thread::yield();
+  }
+}
+
+// Even threads take weak references, so several of them race to install
+// the side block; odd threads keep copying strong references meanwhile,
+// half of them through SharedPtr.
+void RaceSideBlock() {
+  for (int round = 0; round < kRounds; ++round) {
+    IntrusivePtr<Node> node = MakeIntrusive<Node>();
+    std::atomic<int> ready = 0;
+    RunThreads([&](int thread_idx) {
+      IntrusivePtr<Node> own = node;
+      WaitForAll(ready);
+      for (int copy = 0; copy < kCopiesPerRound; ++copy) {
+        if (thread_idx % 2 == 0) {
+          IntrusiveWeakPtr<Node> weak = own;
+          Check(weak.lock().get() == own.get(), "lock() lost a live object");
+        } else if (thread_idx % 4 == 1) {
+          IntrusivePtr<Node> copied = own;
+          Check(copied.get() == own.get(), "copy points elsewhere");
+        } else {
+          SharedPtr<Node> shared = ToShared(own);
+          IntrusivePtr<Node> back = ToIntrusive(shared);
+          Check(back.get() == own.get(), "ToIntrusive lost the object");
+        }
+      }
+    });
+    Check(node.use_count() == 1, "a strong reference leaked");
+  }
+}
+
+// Lockers race with the release of the last strong reference; whatever they
+// lock must still be alive, and once the owner is gone every lock fails.
+void LockWhileExpiring() {
+  for (int round = 0; round < kRounds; ++round) {
+    IntrusivePtr<Node> node = MakeIntrusive<Node>();
+    IntrusiveWeakPtr<Node> weak = node;
+    RunThreads([&](int thread_idx) {
+      if (thread_idx == 0) {
+        node.reset();
+        return;
+      }
+      IntrusiveWeakPtr<Node> own = weak;
+      while (true) {
+        IntrusivePtr<Node> locked = own.lock();
+        if (locked.get() == nullptr) {
+          Check(own.expired(), "lock() failed on a live object");
+          break;
+        }
+        Check(locked->alive.load(), "lock() returned a destroyed object");
+      }
+    });
+    Check(weak.expired(), "object outlived its owners");
+  }
+}
+
+// Objects owned by a SharedPtr control block have no intrusive owner to
+// share with.
+void RejectForeignOwners() {
+  SharedPtr<Node> shared = MakeShared<Node>();
+  Check(ToIntrusive(shared).get() == nullptr,
+        "ToIntrusive adopted a MakeShared object");
+}
+}  // namespace
+
+int main() {
+  RaceSideBlock();
+  LockWhileExpiring();
+  RejectForeignOwners();
+  Check(constructed.load() == destroyed.load(), "objects leaked");
+  if (failed.load()) {
+    return 1;
+  }
+  std::cout << constructed.load() << " objects destroyed exactly once\n";
+  return 0;
+}
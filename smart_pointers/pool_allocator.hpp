@@ -0,0 +1,275 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+#include "smart_pointers.hpp"
+
+// Size-class pool for the small blocks MakeShared produces. Every thread owns
+// a heap with plain free lists. Memory comes from slabs aligned to kSlabSize
+// whose header names the owning heap, so a block finds its owner by masking
+// its address. Blocks freed by another thread are collected into a batch per
+// (owner, size class) and spliced onto the owner's lock-free remote list in
+// one CAS; the owner takes the whole remote list when its local list runs
+// dry. A batch is also flushed once it has waited kRemoteBatchAge pool
+// operations of its thread, and FlushPooledFrees lets a thread that is about
+// to go idle hand over the rest. Heaps of exited threads are handed to new
+// threads, and slabs are kept for the lifetime of the process.
+namespace pool {
+constexpr size_t kGranularity = 16;
+constexpr size_t kMaxBlockSize = 256;
+constexpr size_t kClassCount = kMaxBlockSize / kGranularity;
+constexpr size_t kSlabSize = size_t(64) << 10;
+constexpr size_t kRemoteBatchSize = 32;
+constexpr uint32_t kRemoteBatchAge = 256;
+
+struct FreeNode {
+  FreeNode* next;
+};
+
+class Heap;
+
+struct alignas(64) Slab {
+  Heap* owner;
+  size_t size_class;
+};
+
+inline size_t size_class(size_t bytes) {
+  return bytes == 0 ? 0 : (bytes - 1) / kGranularity;
+}
+
+inline Slab* slab_of(void* block) {
+  return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(block) &
+                                 ~(kSlabSize - 1));
+}
+
+class Heap {
+ public:
+  void* allocate(size_t size_class) {
+    FreeNode*& head = free_[size_class];
+    if (!head) {
+      head = remote_[size_class].exchange(nullptr, std::memory_order_acquire);
+    }
+    if (!head) {
+      return carve(size_class);
+    }
+    FreeNode* node = head;
+    head = node->next;
+    return node;
+  }
+
+  void deallocate_local(void* block, size_t size_class) {
+    auto* node = static_cast<FreeNode*>(block);
+    node->next = free_[size_class];
+    free_[size_class] = node;
+  }
+
+  void push_remote(FreeNode* first, FreeNode* last, size_t size_class) {
+    std::atomic<FreeNode*>& head = remote_[size_class];
+    last->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(last->next, first,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+    }
+  }
+
+ private:
+  void* carve(size_t size_class) {
+    size_t block_size = (size_class + 1) * kGranularity;
+    Cursor& cursor = cursors_[size_class];
+    if (cursor.next + block_size > cursor.end) {
+      auto* slab = static_cast<Slab*>(
+          ::operator new(kSlabSize, std::align_val_t(kSlabSize)));
+      slab->owner = this;
+      slab->size_class = size_class;
+      cursor.next = reinterpret_cast<char*>(slab) + sizeof(Slab);
+      cursor.end = reinterpret_cast<char*>(slab) + kSlabSize;
+    }
+    void* block = cursor.next;
+    cursor.next += block_size;
+    return block;
+  }
+
+  struct Cursor {
+    char* next = nullptr;
+    char* end = nullptr;
+  };
+
+  std::array<FreeNode*, kClassCount> free_{};
+  std::array<Cursor, kClassCount> cursors_{};
+  std::array<std::atomic<FreeNode*>, kClassCount> remote_{};
+};
+
+struct HeapRegistry {
+  std::mutex mutex;
+  std::vector<Heap*> orphans;
+
+  static HeapRegistry& instance() {
+    static HeapRegistry* registry = new HeapRegistry;
+    return *registry;
+  }
+
+  Heap* adopt() {
+    std::lock_guard lock(mutex);
+    if (orphans.empty()) {
+      return new Heap;
+    }
+    Heap* heap = orphans.back();
+    orphans.pop_back();
+    return heap;
+  }
+
+  void orphan(Heap* heap) {
+    std::lock_guard lock(mutex);
+    orphans.push_back(heap);
+  }
+};
+
+// Trivially destructible so that blocks released by later thread_local or
+// static destructors still work; the reaper hands the heap back when the
+// thread exits. After that the thread keeps no heap and no batch: frees go
+// straight to the owner's remote list and allocations borrow an orphaned
+// heap for a single block.
+struct ThreadCache {
+  Heap* heap = nullptr;
+  bool exited = false;
+  uint32_t operations = 0;
+  uint32_t batch_started = 0;
+  Heap* batch_owner = nullptr;
+  size_t batch_class = 0;
+  size_t batch_size = 0;
+  FreeNode* batch_first = nullptr;
+  FreeNode* batch_last = nullptr;
+
+  void flush() {
+    if (batch_size != 0) {
+      batch_owner->push_remote(batch_first, batch_last, batch_class);
+      batch_size = 0;
+      batch_first = batch_last = nullptr;
+    }
+  }
+
+  // Counts a pool operation and flushes a batch that has waited too long.
+  void tick() {
+    ++operations;
+    if (batch_size != 0 && operations - batch_started >= kRemoteBatchAge) {
+      flush();
+    }
+  }
+
+  void deallocate(void* block) {
+    Slab* slab = slab_of(block);
+    auto* node = static_cast<FreeNode*>(block);
+    if (exited) {
+      node->next = nullptr;
+      slab->owner->push_remote(node, node, slab->size_class);
+      return;
+    }
+    tick();
+    if (slab->owner == heap) {
+      heap->deallocate_local(block, slab->size_class);
+      return;
+    }
+    if (slab->owner != batch_owner || slab->size_class != batch_class) {
+      flush();
+      batch_owner = slab->owner;
+      batch_class = slab->size_class;
+    }
+    if (batch_size == 0) {
+      batch_started = operations;
+    }
+    node->next = batch_first;
+    batch_first = node;
+    if (!batch_last) {
+      batch_last = node;
+    }
+    if (++batch_size == kRemoteBatchSize) {
+      flush();
+    }
+  }
+};
+
+inline thread_local ThreadCache tls_cache;
+
+struct ThreadCacheReaper {
+  ~ThreadCacheReaper() {
+    tls_cache.flush();
+    HeapRegistry::instance().orphan(tls_cache.heap);
+    tls_cache.heap = nullptr;
+    tls_cache.exited = true;
+  }
+};
+
+inline ThreadCache& thread_cache() {
+  if (!tls_cache.heap && !tls_cache.exited) {
+    tls_cache.heap = HeapRegistry::instance().adopt();
+    thread_local ThreadCacheReaper reaper;
+    (void)reaper;
+  }
+  return tls_cache;
+}
+
+inline void* allocate(size_t size_class) {
+  ThreadCache& cache = thread_cache();
+  if (cache.exited) {
+    HeapRegistry& registry = HeapRegistry::instance();
+    Heap* heap = registry.adopt();
+    void* block = heap->allocate(size_class);
+    registry.orphan(heap);
+    return block;
+  }
+  cache.tick();
+  return cache.heap->allocate(size_class);
+}
+
+template <typename T>
+constexpr bool is_pooled(size_t n) {
+  return alignof(T) <= kGranularity && n <= kMaxBlockSize / sizeof(T);
+}
+}  // namespace pool
+
+// Allocator for AllocateShared: the rebound AllocateSharedControlBlock of a
+// small object comes from the calling thread's pool. Larger or over-aligned
+// requests fall through to operator new.
+template <typename T>
+class PoolAllocator {
+ public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    if (!pool::is_pooled<T>(n)) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(pool::allocate(pool::size_class(n * sizeof(T))));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (!pool::is_pooled<T>(n)) {
+      std::allocator<T>().deallocate(ptr, n);
+      return;
+    }
+    pool::thread_cache().deallocate(ptr);
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U>&) const {
+    return true;
+  }
+};
+
+// Hands this thread's pending cross-thread frees to their owners, for a
+// thread that is about to block for a long time.
+inline void FlushPooledFrees() { pool::tls_cache.flush(); }
+
+template <typename T, typename... Args>
+SharedPtr<T> MakePooledShared(Args&&... args) {
+  return AllocateShared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
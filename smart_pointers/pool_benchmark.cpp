@@ -0,0 +1,133 @@
+// Churn benchmark of MakePooledShared against MakeShared (glibc malloc).
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/pool_benchmark.cpp -o pool_benchmark
+// Local churn: every thread replaces 48-byte messages in a window of
+// kWindow live ones, so blocks are freed by the thread that made them.
+// Handoff: producers pass every message through a ring to a consumer that
+// drops it, so every free is cross-thread. Prints nanoseconds per
+// make+drop, summed over threads, best of kRepeats runs.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "pool_allocator.hpp"
+
+namespace {
+const int kRepeats = 3;
+const int kWindow = 64;
+const int kMessagesPerThread = 1'000'000;
+const size_t kRingSize = 1024;
+
+struct Message {
+  char payload[48];
+};
+
+SharedPtr<Message> MakeMalloc() { return MakeShared<Message>(); }
+
+SharedPtr<Message> MakePooled() { return MakePooledShared<Message>(); }
+
+// Single-producer single-consumer ring; both sides yield instead of
+// spinning so that the benchmark also makes progress on one CPU.
+class Ring {
+ public:
+  void Push(SharedPtr<Message> message) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    while (tail - head_.load(std::memory_order_acquire) == kRingSize) {
+      std::this_thread::yield();
+    }
+    slots_[tail % kRingSize] = std::move(message);
+    tail_.store(tail + 1, std::memory_order_release);
+  }
+
+  SharedPtr<Message> Pop() {
+    size_t head = head_.load(std::memory_order_relaxed);
+    while (tail_.load(std::memory_order_acquire) == head) {
+      std::this_thread::yield();
+    }
+    SharedPtr<Message> message = std::move(slots_[head % kRingSize]);
+    head_.store(head + 1, std::memory_order_release);
+    return message;
+  }
+
+ private:
+  std::vector<SharedPtr<Message>> slots_ =
+      std::vector<SharedPtr<Message>>(kRingSize);
+  alignas(64) std::atomic<size_t> head_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+};
+
+template <typename Body>
+double BestNanosecondsPerMessage(int messages, const Body& body) {
+  double best = 0;
+  for (int repeat = 0; repeat < kRepeats; ++repeat) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    double per_message = elapsed.count() / messages;
+    best = repeat == 0 ? per_message : std::min(best, per_message);
+  }
+  return best;
+}
+
+template <typename Make>
+double LocalChurn(int thread_count, Make make) {
+  return BestNanosecondsPerMessage(thread_count * kMessagesPerThread, [&] {
+    std::vector<std::thread> threads;
+    for (int thread_idx = 0; thread_idx < thread_count; ++thread_idx) {
+      threads.emplace_back([&] {
+        std::vector<SharedPtr<Message>> window(kWindow);
+        for (int message = 0; message < kMessagesPerThread; ++message) {
+          window[message % kWindow] = make();
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  });
+}
+
+template <typename Make>
+double Handoff(int pair_count, Make make) {
+  return BestNanosecondsPerMessage(pair_count * kMessagesPerThread, [&] {
+    std::vector<Ring> rings(pair_count);
+    std::vector<std::thread> threads;
+    for (Ring& ring : rings) {
+      threads.emplace_back([&] {
+        for (int message = 0; message < kMessagesPerThread; ++message) {
+          ring.Push(make());
+        }
+      });
+      threads.emplace_back([&] {
+        for (int message = 0; message < kMessagesPerThread; ++message) {
+          ring.Pop();
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  });
+}
+}  // namespace
+
+int main() {
+  std::cout << "ns/message   threads   MakeShared   MakePooledShared\n";
+  for (int thread_count : {1, 4, 8}) {
+    std::cout << std::left << std::setw(13) << "local" << std::right
+              << std::setw(7) << thread_count << std::fixed
+              << std::setprecision(1) << std::setw(13)
+              << LocalChurn(thread_count, MakeMalloc) << std::setw(19)
+              << LocalChurn(thread_count, MakePooled) << "\n";
+  }
+  for (int pair_count : {1, 4}) {
+    std::cout << std::left << std::setw(13) << "handoff" << std::right
+              << std::setw(7) << 2 * pair_count << std::setw(13)
+              << Handoff(pair_count, MakeMalloc) << std::setw(19)
+              << Handoff(pair_count, MakePooled) << "\n";
+  }
+}
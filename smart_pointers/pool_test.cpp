@@ -0,0 +1,97 @@
+// Lifecycle test of the PoolAllocator thread caches.
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/pool_test.cpp -o pool_test
+// Best run again with -fsanitize=thread and -fsanitize=address.
+// A consumer frees fewer blocks than a batch holds and then only works on
+// its own heap; the producer must get those blocks back without the
+// consumer exiting or flushing. A thread_local destroyed after the thread's
+// cache was reaped must still be able to free and allocate. Exits with a
+// non-zero status on the first error.
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "pool_allocator.hpp"
+
+namespace {
+const int kHandedOff = 8;
+
+struct Message {
+  char payload[40];
+};
+
+static_assert(kHandedOff < pool::kRemoteBatchSize);
+
+// Returns how many of the handed-off blocks the producer allocated again.
+int ReusedAfterIdleConsumer() {
+  std::vector<SharedPtr<Message>> handoff;
+  std::set<Message*> handed_off;
+  std::set<Message*> reallocated;
+  std::thread producer([&] {
+    for (int i = 0; i < kHandedOff; ++i) {
+      handoff.push_back(MakePooledShared<Message>());
+      handed_off.insert(handoff.back().get());
+    }
+    std::atomic<bool> freed = false;
+    std::atomic<bool> done = false;
+    std::thread consumer([&] {
+      handoff.clear();
+      for (uint32_t i = 0; i < pool::kRemoteBatchAge; ++i) {
+        SharedPtr<Message> local = MakePooledShared<Message>();
+      }
+      freed = true;
+      while (!done) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+    while (!freed) {
+      std::this_thread::yield();
+    }
+    for (int i = 0; i < kHandedOff; ++i) {
+      handoff.push_back(MakePooledShared<Message>());
+      reallocated.insert(handoff.back().get());
+    }
+    done = true;
+    consumer.join();
+    handoff.clear();
+  });
+  producer.join();
+  return std::count_if(reallocated.begin(), reallocated.end(),
+                       [&](Message* block) { return handed_off.count(block); });
+}
+
+struct LateOwner {
+  SharedPtr<Message> message;
+
+  ~LateOwner() {
+    message.reset();
+    message = MakePooledShared<Message>();
+    message.reset();
+  }
+};
+
+// late is constructed before the thread's cache, so it is destroyed after
+// the reaper has handed the heap back.
+void FreeAfterReaper() {
+  std::thread thread([] {
+    thread_local LateOwner late;
+    late.message = MakePooledShared<Message>();
+  });
+  thread.join();
+}
+}  // namespace
+
+int main() {
+  int reused = ReusedAfterIdleConsumer();
+  FreeAfterReaper();
+  if (reused != kHandedOff) {
+    std::cerr << "producer got back " << reused << " of " << kHandedOff
+              << " blocks freed by an idle consumer\n";
+    return 1;
+  }
+  std::cout << "idle consumer returned all " << kHandedOff
+            << " blocks; late frees after the reaper succeeded\n";
+  return 0;
+}
@@ -0,0 +1,138 @@
+// Test of DeferredDelete and the Reclaimer worker.
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/reclaim_test.cpp -o reclaim_test
+// Best run again with -fsanitize=thread and -fsanitize=address.
+// An object retired alone into an idle reclaimer must be destroyed within
+// the epoch interval plus scheduling slack. Producers then retire objects
+// while another thread keeps flushing; after a final flush everything must
+// be destroyed exactly once. After drain() retires run inline, including
+// the one from a static SharedPtr made before the reclaimer existed, which
+// is released after main returns. Exits with a non-zero status on the first
+// error.
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "deferred_reclaim.hpp"
+#include "smart_pointers.hpp"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+const std::chrono::milliseconds kSlack{20};
+const int kLatencyTrials = 10;
+const int kProducerCount = 4;
+const int kObjectsPerProducer = 20000;
+
+std::atomic<int> constructed = 0;
+std::atomic<int> destroyed = 0;
+std::atomic<bool> failed = false;
+
+struct Tracked {
+  std::atomic<bool> alive = true;
+  std::atomic<Clock::time_point>* destroyed_at = nullptr;
+
+  Tracked() { constructed.fetch_add(1, std::memory_order_relaxed); }
+
+  ~Tracked() {
+    if (!alive.exchange(false)) {
+      failed = true;
+    }
+    if (destroyed_at) {
+      destroyed_at->store(Clock::now());
+    }
+    destroyed.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+SharedPtr<Tracked> MakeDeferred() {
+  return SharedPtr<Tracked>(new Tracked, DeferredDelete<Tracked>());
+}
+
+// Released during static destruction, after main has drained the reclaimer.
+SharedPtr<Tracked> early = MakeDeferred();
+
+void Check(bool condition, const char* what) {
+  if (!condition && !failed.exchange(true)) {
+    std::cerr << what << "\n";
+  }
+}
+
+// Returns the slowest reclamation of a lone object, in milliseconds.
+double LoneRetireLatency() {
+  Clock::duration slowest{};
+  for (int trial = 0; trial < kLatencyTrials; ++trial) {
+    Reclaimer::instance().flush();
+    // Let the worker go back to sleep on an empty queue.
+    std::this_thread::sleep_for(5 * Reclaimer::kEpochInterval);
+    std::atomic<Clock::time_point> destroyed_at = Clock::time_point();
+    SharedPtr<Tracked> object = MakeDeferred();
+    object->destroyed_at = &destroyed_at;
+    Clock::time_point retired = Clock::now();
+    object.reset();
+    Clock::time_point deadline =
+        retired + Reclaimer::kEpochInterval + kSlack;
+    while (destroyed_at.load() == Clock::time_point() &&
+           Clock::now() < deadline) {
+      std::this_thread::yield();
+    }
+    Check(destroyed_at.load() != Clock::time_point(),
+          "a lone retired object was not reclaimed within the epoch");
+    if (destroyed_at.load() == Clock::time_point()) {
+      Reclaimer::instance().flush();
+      return -1;
+    }
+    slowest = std::max(slowest, destroyed_at.load() - retired);
+  }
+  return std::chrono::duration<double, std::milli>(slowest).count();
+}
+
+void ProduceWhileFlushing() {
+  std::atomic<int> producers_left = kProducerCount;
+  std::vector<std::thread> threads;
+  for (int producer = 0; producer < kProducerCount; ++producer) {
+    threads.emplace_back([&] {
+      for (int object = 0; object < kObjectsPerProducer; ++object) {
+        SharedPtr<Tracked> shared = MakeDeferred();
+        WeakPtr<Tracked> weak = shared;
+        shared.reset();
+        Check(weak.expired(), "WeakPtr outlived a deferred object");
+      }
+      producers_left.fetch_sub(1);
+    });
+  }
+  threads.emplace_back([&] {
+    while (producers_left.load() != 0) {
+      Reclaimer::instance().flush();
+    }
+  });
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  Reclaimer::instance().flush();
+  Check(Reclaimer::instance().queue_depth() == 0, "flush left objects queued");
+  // early is still alive.
+  Check(destroyed.load() == constructed.load() - 1,
+        "flush did not destroy everything retired before it");
+}
+
+void RetireAfterDrain() {
+  Reclaimer::instance().drain();
+  int before = destroyed.load();
+  MakeDeferred().reset();
+  Check(destroyed.load() == before + 1, "retire after drain was not inline");
+}
+}  // namespace
+
+int main() {
+  double latency = LoneRetireLatency();
+  ProduceWhileFlushing();
+  RetireAfterDrain();
+  if (failed.load()) {
+    return 1;
+  }
+  std::cout << "lone retire reclaimed within " << latency << " ms; "
+            << destroyed.load() << " objects destroyed exactly once\n";
+  return 0;
+}
@@ -1,26 +1,60 @@
+#pragma once
+#include <functional>
 #include "control_block.hpp"
 
+template <typename T>
+class WeakPtr;
+
+// A raw Y* may be owned by SharedPtr<T>. SharedPtr<U[]> only accepts U*, not
+// pointers to derived elements.
+template <typename Y, typename T>
+concept OwnablePointer = (std::is_array_v<T>
+                              ? std::is_convertible_v<Y (*)[], T*>
+                              : std::is_convertible_v<Y*, T*>);
+
 template <typename T>
 class SharedPtr {
  public:
+  using element_type = std::remove_extent_t<T>;
+
   SharedPtr() = default;
 
   SharedPtr(std::nullptr_t){};
 
   template <typename Y>
-    requires std::is_convertible_v<Y*, T*>
-  SharedPtr(Y* ptr) : ptr_(ptr), control_(new BaseControlBlock<T>(ptr_)) {}
+    requires OwnablePointer<Y, T>
+  SharedPtr(Y* ptr)
+      : SharedPtr(ptr,
+                  std::conditional_t<std::is_array_v<T>, std::default_delete<T>,
+                                     std::default_delete<Y>>(),
+                  std::allocator<Y>()) {}
 
   template <typename Y, typename Deleter>
-    requires std::is_convertible_v<Y*, T*>
+    requires OwnablePointer<Y, T>
   SharedPtr(Y* ptr, Deleter deleter)
-      : ptr_(ptr),
-        control_(new AllocatorControlBlock<T, Deleter>(ptr_, deleter)) {}
+      : SharedPtr(ptr, deleter, std::allocator<Y>()) {}
 
   template <typename Y, typename Deleter, typename Allocator>
-    requires std::is_convertible_v<Y*, T*>
+    requires OwnablePointer<Y, T>
   SharedPtr(Y* ptr, Deleter deleter, Allocator allocator);
 
+  // Aliasing: shares ownership with `owner` but points at `ptr`, typically a
+  // member or a slice of the owned object.
+  template <typename Y>
+  SharedPtr(const SharedPtr<Y>& owner, element_type* ptr)
+      : ptr_(ptr), control_(owner.control_) {
+    if (control_) {
+      control_->add_shared();
+    }
+  }
+
+  template <typename Y>
+  SharedPtr(SharedPtr<Y>&& owner, element_type* ptr)
+      : ptr_(ptr), control_(owner.control_) {
+    owner.ptr_ = nullptr;
+    owner.control_ = nullptr;
+  }
+
   template <typename Y>
     requires std::is_convertible_v<Y*, T*>
   SharedPtr(const SharedPtr<Y>& other);
@@ -45,29 +79,69 @@ class SharedPtr {
 
   SharedPtr& operator=(SharedPtr&& other);
 
-  T* get() const { return ptr_; };
+  element_type* get() const { return ptr_; };
 
   void swap(SharedPtr<T>& other);
 
-  size_t use_count() const { return control_ ? (control_->shared_count) : 0; };
+  size_t use_count() const { return control_ ? control_->use_count() : 0; };
 
-  T* operator->() const { return ptr_; };
+  T* operator->() const
+    requires(!std::is_array_v<T>)
+  {
+    return ptr_;
+  };
+
+  T& operator*() const
+    requires(!std::is_array_v<T>)
+  {
+    return *ptr_;
+  };
 
-  T& operator*() const { return *ptr_; };
+  element_type& operator[](std::ptrdiff_t index) const
+    requires std::is_array_v<T>
+  {
+    return ptr_[index];
+  }
 
   void reset() { SharedPtr().swap(*this); };
 
+  template <typename Y>
+  bool owner_before(const SharedPtr<Y>& other) const {
+    return std::less<>()(control_, other.control_);
+  }
+
+  template <typename Y>
+  bool owner_before(const WeakPtr<Y>& other) const {
+    return std::less<>()(control_, other.control_);
+  }
+
+  template <typename Y>
+  bool owner_equal(const SharedPtr<Y>& other) const {
+    return control_ == other.control_;
+  }
+
+  template <typename Y>
+  bool owner_equal(const WeakPtr<Y>& other) const {
+    return control_ == other.control_;
+  }
+
+  size_t owner_hash() const { return std::hash<BaseControlBlock*>()(control_); }
+
   ~SharedPtr();
 
  private:
-  SharedPtr(BaseControlBlock<T>* block) : ptr_(block->ptr), control_(block){};
+  SharedPtr(element_type* ptr, BaseControlBlock* block)
+      : ptr_(ptr), control_(block){};
 
   template <typename U, typename Allocator, typename... Args>
   friend SharedPtr<U> AllocateShared(const Allocator& allocator,
                                      Args&&... args);
 
   template <typename U, typename... Args>
-  friend SharedPtr<U> MakeShared(Args&&... args);
+  friend SharedPtr<U> MakeLocalShared(Args&&... args);
+
+  template <typename U, typename... Args>
+  friend SharedPtr<U> MakeBiasedShared(Args&&... args);
 
   template <typename X>
   friend class SharedPtr;
@@ -75,8 +149,11 @@ class SharedPtr {
   template <typename U>
   friend class WeakPtr;
 
-  T* ptr_ = nullptr;
-  BaseControlBlock<T>* control_ = nullptr;
+  template <typename U>
+  friend class AtomicSharedPtr;
+
+  element_type* ptr_ = nullptr;
+  BaseControlBlock* control_ = nullptr;
 };
 
 template <typename T>
@@ -90,7 +167,7 @@ template <typename T>
 template <typename Y>
   requires std::is_convertible_v<Y*, T*>
 SharedPtr<T>& SharedPtr<T>::operator=(const SharedPtr<Y>& other) {
-  if (ptr_ != dynamic_cast<T*>(other.ptr_)) {
+  if (ptr_ != other.ptr_ || control_ != other.control_) {
     SharedPtr(other).swap(*this);
   }
   return *this;
@@ -98,7 +175,7 @@ SharedPtr<T>& SharedPtr<T>::operator=(const SharedPtr<Y>& other) {
 
 template <typename T>
 SharedPtr<T>& SharedPtr<T>::operator=(const SharedPtr& other) {
-  if (ptr_ != other.ptr_) {
+  if (ptr_ != other.ptr_ || control_ != other.control_) {
     SharedPtr(other).swap(*this);
   }
   return *this;
@@ -108,7 +185,7 @@ template <typename T>
 template <typename Y>
   requires std::is_convertible_v<Y*, T*>
 SharedPtr<T>& SharedPtr<T>::operator=(SharedPtr<Y>&& other) {
-  if (ptr_ != dynamic_cast<T*>(other.ptr_)) {
+  if (ptr_ != other.ptr_ || control_ != other.control_) {
     SharedPtr(std::move(other)).swap(*this);
   }
   return *this;
@@ -116,7 +193,7 @@ SharedPtr<T>& SharedPtr<T>::operator=(SharedPtr<Y>&& other) {
 
 template <typename T>
 SharedPtr<T>& SharedPtr<T>::operator=(SharedPtr&& other) {
-  if (ptr_ != other.ptr_) {
+  if (ptr_ != other.ptr_ || control_ != other.control_) {
     SharedPtr(std::move(other)).swap(*this);
   }
   return *this;
@@ -132,8 +209,7 @@ template <typename T>
 template <typename Y>
   requires std::is_convertible_v<Y*, T*>
 SharedPtr<T>::SharedPtr(SharedPtr<Y>&& other)
-    : ptr_(other.ptr_),
-      control_(dynamic_cast<BaseControlBlock<T>*>(other.control_)) {
+    : ptr_(other.ptr_), control_(other.control_) {
   other.ptr_ = nullptr;
   other.control_ = nullptr;
 }
@@ -149,9 +225,8 @@ template <typename T>
 template <typename Y>
   requires std::is_convertible_v<Y*, T*>
 SharedPtr<T>::SharedPtr(const SharedPtr<Y>& other)
-    : ptr_(other.ptr_),
-      control_(dynamic_cast<BaseControlBlock<T>*>(other.control_)) {
-  if (control_ && *control_) {
+    : ptr_(other.ptr_), control_(other.control_) {
+  if (control_) {
     control_->add_shared();
   }
 }
@@ -159,58 +234,138 @@ SharedPtr<T>::SharedPtr(const SharedPtr<Y>& other)
 template <typename T>
 SharedPtr<T>::SharedPtr(const SharedPtr& other)
     : ptr_(other.ptr_), control_(other.control_) {
-  if (*control_) {
+  if (control_) {
     control_->add_shared();
   }
 }
 
 template <typename T>
 template <typename Y, typename Deleter, typename Allocator>
-  requires std::is_convertible_v<Y*, T*>
+  requires OwnablePointer<Y, T>
 SharedPtr<T>::SharedPtr(Y* ptr, Deleter deleter, Allocator allocator)
     : ptr_(ptr) {
-  auto new_allocator =
-      typename std::allocator_traits<Allocator>::template rebind_alloc<
-          AllocatorControlBlock<Y, Deleter, Allocator>>(allocator);
-  using NewTraits = std::allocator_traits<decltype(new_allocator)>;
-  auto control = NewTraits::allocate(new_allocator, 1);
+  using Block = AllocatorControlBlock<Y, Deleter, Allocator>;
+  using BlockAlloc =
+      std::allocator_traits<Allocator>::template rebind_alloc<Block>;
+  BlockAlloc block_allocator(allocator);
+  using BlockTraits = std::allocator_traits<BlockAlloc>;
+  Block* control = BlockTraits::allocate(block_allocator, 1);
+  BlockTraits::construct(block_allocator, control, ptr, deleter, allocator);
   control_ = control;
-  NewTraits::construct(new_allocator, control, ptr, deleter, allocator);
 }
 
 template <typename T>
 class WeakPtr {
  public:
+  using element_type = std::remove_extent_t<T>;
+
   WeakPtr() = default;
 
-  WeakPtr(const WeakPtr& other) : control_(other.control_) {
-    control_->add_weak();
+  WeakPtr(const WeakPtr& other) : ptr_(other.ptr_), control_(other.control_) {
+    if (control_) {
+      control_->add_weak();
+    }
   };
 
-  WeakPtr(WeakPtr&& other) : control_(std::move(other.control_)) {
+  WeakPtr(WeakPtr&& other) : ptr_(other.ptr_), control_(other.control_) {
+    other.ptr_ = nullptr;
     other.control_ = nullptr;
   };
 
-  WeakPtr(const SharedPtr<T>& other) : control_(other.control_) {
-    control_->add_weak();
+  WeakPtr(const SharedPtr<T>& other)
+      : ptr_(other.ptr_), control_(other.control_) {
+    if (control_) {
+      control_->add_weak();
+    }
   };
 
   WeakPtr& operator=(const WeakPtr& other);
 
   WeakPtr& operator=(WeakPtr&& other);
 
-  bool expired() const { return (control_->shared_count) == 0; };
+  bool expired() const { return !control_ || control_->use_count() == 0; };
 
   SharedPtr<T> lock() const {
-    return expired() ? nullptr : SharedPtr<T>(control_);
+    if (!control_ || !control_->try_add_shared()) {
+      return nullptr;
+    }
+    return SharedPtr<T>(ptr_, control_);
   };
 
-  void swap(WeakPtr& other) { std::swap(control_, other.control_); }
+  void swap(WeakPtr& other) {
+    std::swap(ptr_, other.ptr_);
+    std::swap(control_, other.control_);
+  }
 
-  ~WeakPtr() { control_->release_weak(); };
+  // The owner stays the same after expiry, so weak keys keep their place in
+  // ordered and hashed containers and can be swept by checking expired().
+  template <typename Y>
+  bool owner_before(const WeakPtr<Y>& other) const {
+    return std::less<>()(control_, other.control_);
+  }
+
+  template <typename Y>
+  bool owner_before(const SharedPtr<Y>& other) const {
+    return std::less<>()(control_, other.control_);
+  }
+
+  template <typename Y>
+  bool owner_equal(const WeakPtr<Y>& other) const {
+    return control_ == other.control_;
+  }
+
+  template <typename Y>
+  bool owner_equal(const SharedPtr<Y>& other) const {
+    return control_ == other.control_;
+  }
+
+  size_t owner_hash() const { return std::hash<BaseControlBlock*>()(control_); }
+
+  ~WeakPtr() {
+    if (control_) {
+      control_->release_weak();
+    }
+  };
 
  private:
-  BaseControlBlock<T>* control_ = nullptr;
+  template <typename U>
+  friend class WeakPtr;
+
+  template <typename U>
+  friend class SharedPtr;
+
+  element_type* ptr_ = nullptr;
+  BaseControlBlock* control_ = nullptr;
+};
+
+// Owner-based comparators for SharedPtr and WeakPtr keys. They are
+// transparent, so a weak-keyed container can be probed with a SharedPtr
+// without touching the reference counts.
+struct OwnerLess {
+  using is_transparent = void;
+
+  template <typename Lhs, typename Rhs>
+  bool operator()(const Lhs& lhs, const Rhs& rhs) const {
+    return lhs.owner_before(rhs);
+  }
+};
+
+struct OwnerHash {
+  using is_transparent = void;
+
+  template <typename Pointer>
+  size_t operator()(const Pointer& pointer) const {
+    return pointer.owner_hash();
+  }
+};
+
+struct OwnerEqual {
+  using is_transparent = void;
+
+  template <typename Lhs, typename Rhs>
+  bool operator()(const Lhs& lhs, const Rhs& rhs) const {
+    return lhs.owner_equal(rhs);
+  }
 };
 
 template <typename T>
@@ -229,23 +384,48 @@ WeakPtr<T>& WeakPtr<T>::operator=(WeakPtr&& other) {
   return *this;
 }
 
+// For T = U[] the only argument is the element count; the elements are
+// value-initialized and share one allocation with the control block.
 template <typename T, typename Allocator, typename... Args>
 SharedPtr<T> AllocateShared(const Allocator& allocator, Args&&... args) {
-  using Traits = std::allocator_traits<Allocator>;
-  using BlockAlloc =
-      Traits::template rebind_alloc<AllocateSharedControlBlock<T, Allocator>>;
-  BlockAlloc block_alloc(allocator);
-  using BlockTraits = std::allocator_traits<decltype(block_alloc)>;
+  if constexpr (std::is_unbounded_array_v<T>) {
+    using Block = ArrayControlBlock<std::remove_extent_t<T>, Allocator>;
+    Block* block = Block::create(allocator, args...);
+    return SharedPtr<T>(block->elements(),
+                        static_cast<BaseControlBlock*>(block));
+  } else {
+    using Block = AllocateSharedControlBlock<T, Allocator>;
+    Block* block = Block::create(allocator, std::forward<Args>(args)...);
+    return SharedPtr<T>(&block->object, static_cast<BaseControlBlock*>(block));
+  }
+}
 
-  auto* block = BlockTraits::allocate(block_alloc, 1);
-  BlockTraits::construct(block_alloc, block, allocator,
-                         std::forward<Args>(args)...);
+template <typename T, typename... Args>
+SharedPtr<T> MakeShared(Args&&... args) {
+  using Allocator = std::allocator<std::remove_extent_t<T>>;
+  return AllocateShared<T, Allocator, Args...>(Allocator(),
+                                               std::forward<Args>(args)...);
+}
 
-  return SharedPtr<T>(dynamic_cast<BaseControlBlock<T>*>(block));
+// For objects that never leave the creating thread: copies and releases
+// skip the atomic read-modify-write instructions.
+template <typename T, typename... Args>
+SharedPtr<T> MakeLocalShared(Args&&... args) {
+  SharedPtr<T> shared = MakeShared<T>(std::forward<Args>(args)...);
+  shared.control_->policy = RefCountPolicy::kLocal;
+  return shared;
 }
 
+// For objects copied mostly on the creating thread: that thread counts its
+// references without atomics, while other threads may still share the object.
+// Releasing the creator's references elsewhere costs one heavy fence per
+// object (see BiasedControlBlock).
 template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-  return AllocateShared<T, std::allocator<T>, Args...>(
-      std::allocator<T>(), std::forward<Args>(args)...);
-}
\ No newline at end of file
+SharedPtr<T> MakeBiasedShared(Args&&... args) {
+  using Block =
+      AllocateSharedControlBlock<T, std::allocator<T>, BiasedControlBlock>;
+  Block* block =
+      Block::create(std::allocator<T>(), std::forward<Args>(args)...);
+  block->bias_to_current_thread();
+  return SharedPtr<T>(&block->object, static_cast<BaseControlBlock*>(block));
+}
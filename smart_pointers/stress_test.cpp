@@ -0,0 +1,139 @@
+// Multithreaded stress test of SharedPtr and WeakPtr reference counting.
+//   g++ -std=c++20 -O2 -pthread -I smart_pointers smart_pointers/stress_test.cpp -o stress_test
+// Best run again with -fsanitize=thread and -fsanitize=address.
+// Threads copy, move, destroy and lock pointers to objects that other threads
+// release at the same time. Every object must be destroyed exactly once, no
+// lock() may return a destroyed object, and the copy/destroy throughput of
+// the last phase is printed. Exits with a non-zero status on the first error.
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "smart_pointers.hpp"
+
+namespace {
+const int kThreadCount = 4;
+const int kRounds = 1000;
+const int kCopiesPerRound = 64;
+const int kThroughputIterations = 1'000'000;
+
+std::atomic<int> constructed = 0;
+std::atomic<int> destroyed = 0;
+std::atomic<bool> failed = false;
+
+struct Tracked {
+  std::atomic<bool> alive = true;
+
+  Tracked() { constructed.fetch_add(1, std::memory_order_relaxed); }
+
+  ~Tracked() {
+    if (!alive.exchange(false)) {
+      failed = true;
+    }
+    destroyed.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+void Check(bool condition, const char* what) {
+  if (!condition && !failed.exchange(true)) {
+    std::cerr << what << "\n";
+  }
+}
+
+template <typename Work>
+void RunThreads(int thread_count, const Work& work) {
+  std::vector<std::thread> threads;
+  for (int thread_idx = 0; thread_idx < thread_count; ++thread_idx) {
+    threads.emplace_back(work, thread_idx);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+// Every round the threads copy the same pointer back and forth while its
+// creator drops its own reference; the last thread out destroys the object.
+void CopyAndRelease() {
+  for (int round = 0; round < kRounds; ++round) {
+    SharedPtr<Tracked> shared = MakeShared<Tracked>();
+    std::atomic<int> ready = 0;
+    RunThreads(kThreadCount, [&](int thread_idx) {
+      SharedPtr<Tracked> own = shared;
+      ready.fetch_add(1);
+      while (ready.load() != kThreadCount) {
+        std::this_thread::yield();
+      }
+      if (thread_idx == 0) {
+        shared.reset();
+      }
+      std::vector<SharedPtr<Tracked>> copies;
+      for (int copy = 0; copy < kCopiesPerRound; ++copy) {
+        copies.push_back(own);
+        SharedPtr<Tracked> moved = std::move(copies.back());
+        copies.back() = moved;
+      }
+      Check(own->alive.load(), "copied a destroyed object");
+    });
+    Check(shared.get() == nullptr, "reset left the pointer set");
+  }
+}
+
+// Lockers race with the release of the last strong reference; whatever they
+// lock must still be alive, and once the owner is gone every lock fails.
+void LockWhileExpiring() {
+  for (int round = 0; round < kRounds; ++round) {
+    SharedPtr<Tracked> shared = MakeShared<Tracked>();
+    WeakPtr<Tracked> weak = shared;
+    RunThreads(kThreadCount, [&](int thread_idx) {
+      if (thread_idx == 0) {
+        shared.reset();
+        return;
+      }
+      WeakPtr<Tracked> own = weak;
+      while (true) {
+        SharedPtr<Tracked> locked = own.lock();
+        if (!locked.get()) {
+          Check(own.expired(), "lock() failed on a live object");
+          break;
+        }
+        Check(locked->alive.load(), "lock() returned a destroyed object");
+      }
+    });
+    Check(weak.expired() && !weak.lock().get(), "object outlived its owners");
+  }
+}
+
+// Copy/destroy throughput on one object shared by all threads.
+void MeasureThroughput(int thread_count) {
+  SharedPtr<Tracked> shared = MakeShared<Tracked>();
+  auto start = std::chrono::steady_clock::now();
+  RunThreads(thread_count, [&](int) {
+    for (int iteration = 0; iteration < kThroughputIterations; ++iteration) {
+      SharedPtr<Tracked> copy = shared;
+      Check(copy.get() == shared.get(), "copy points elsewhere");
+    }
+  });
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  Check(shared.use_count() == 1, "copies leaked a reference");
+  std::cout << thread_count << " threads: "
+            << thread_count * kThroughputIterations / elapsed.count() / 1e6
+            << " M copy/destroy pairs per second\n";
+}
+}  // namespace
+
+int main() {
+  CopyAndRelease();
+  LockWhileExpiring();
+  for (int thread_count = 1; thread_count <= kThreadCount; thread_count *= 2) {
+    MeasureThroughput(thread_count);
+  }
+  Check(constructed.load() == destroyed.load(), "objects leaked");
+  if (failed.load()) {
+    return 1;
+  }
+  std::cout << constructed.load() << " objects destroyed exactly once\n";
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "intern_pool.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <vector>
+
+namespace {
+const size_t kShardCount = 64;
+const size_t kBlockSize = 1 << 16;
+const size_t kInitialTableSize = 64;
+
+uint64_t HashBytes(const char* string, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(string[i]);
+    hash *= 0x100000001B3ULL;
+  }
+  return hash ^ (hash >> 32);
+}
+}  // namespace
+
+struct InternedString::Record {
+  uint64_t hash;
+  size_t size;
+
+  const char* Data() const { return reinterpret_cast<const char*>(this + 1); }
+};
+
+const char* InternedString::Data() const {
+  return record_ != nullptr ? record_->Data() : "";
+}
+
+size_t InternedString::Size() const {
+  return record_ != nullptr ? record_->size : 0;
+}
+
+size_t InternedString::Hash() const {
+  return record_ != nullptr ? record_->hash : 0;
+}
+
+String InternedString::ToString() const {
+  String string;
+  string.Append(Data(), Size());
+  return string;
+}
+
+std::ostream& operator<<(std::ostream& os, const InternedString& string) {
+  os.write(string.Data(), static_cast<std::streamsize>(string.Size()));
+  return os;
+}
+
+struct alignas(64) InternPool::Shard {
+  using Record = InternedString::Record;
+
+  const Record* Find(uint64_t hash, const char* string, size_t size) const;
+
+  const Record* Insert(uint64_t hash, const char* string, size_t size);
+
+  char* Allocate(size_t size);
+
+  void Rehash();
+
+  mutable std::shared_mutex mutex;
+  std::vector<const Record*> table =
+      std::vector<const Record*>(kInitialTableSize, nullptr);
+  size_t count = 0;
+  std::vector<std::unique_ptr<char[]>> blocks;
+  char* cursor = nullptr;
+  char* block_end = nullptr;
+};
+
+const InternedString::Record* InternPool::Shard::Find(uint64_t hash,
+                                                      const char* string,
+                                                      size_t size) const {
+  size_t mask = table.size() - 1;
+  for (size_t idx = hash & mask; table[idx] != nullptr; idx = (idx + 1) & mask) {
+    const Record* record = table[idx];
+    if (record->hash == hash && record->size == size &&
+        std::memcmp(record->Data(), string, size) == 0) {
+      return record;
+    }
+  }
+  return nullptr;
+}
+
+char* InternPool::Shard::Allocate(size_t size) {
+  size = (size + alignof(Record) - 1) & ~(alignof(Record) - 1);
+  if (static_cast<size_t>(block_end - cursor) < size) {
+    size_t block_size = std::max(size, kBlockSize);
+    blocks.push_back(std::make_unique<char[]>(block_size));
+    cursor = blocks.back().get();
+    block_end = cursor + block_size;
+  }
+  char* memory = cursor;
+  cursor += size;
+  return memory;
+}
+
+void InternPool::Shard::Rehash() {
+  std::vector<const Record*> new_table(table.size() * 2, nullptr);
+  size_t mask = new_table.size() - 1;
+  for (const Record* record : table) {
+    if (record != nullptr) {
+      size_t idx = record->hash & mask;
+      while (new_table[idx] != nullptr) {
+        idx = (idx + 1) & mask;
+      }
+      new_table[idx] = record;
+    }
+  }
+  table.swap(new_table);
+}
+
+const InternedString::Record* InternPool::Shard::Insert(uint64_t hash,
+                                                        const char* string,
+                                                        size_t size) {
+  if ((count + 1) * 2 > table.size()) {
+    Rehash();
+  }
+  auto* record = new (Allocate(sizeof(Record) + size)) Record{hash, size};
+  std::memcpy(const_cast<char*>(record->Data()), string, size);
+  size_t mask = table.size() - 1;
+  size_t idx = hash & mask;
+  while (table[idx] != nullptr) {
+    idx = (idx + 1) & mask;
+  }
+  table[idx] = record;
+  ++count;
+  return record;
+}
+
+InternPool::InternPool() : shards_(std::make_unique<Shard[]>(kShardCount)) {}
+
+InternPool::~InternPool() = default;
+
+InternedString InternPool::Intern(const char* string, size_t size) {
+  if (size == 0) {
+    return InternedString();
+  }
+  uint64_t hash = HashBytes(string, size);
+  // Low bits pick the table slot, so shards are chosen by the high ones.
+  Shard& shard = shards_[(hash >> 58) % kShardCount];
+  {
+    std::shared_lock lock(shard.mutex);
+    if (const auto* record = shard.Find(hash, string, size)) {
+      return InternedString(record);
+    }
+  }
+  std::unique_lock lock(shard.mutex);
+  if (const auto* record = shard.Find(hash, string, size)) {
+    return InternedString(record);
+  }
+  return InternedString(shard.Insert(hash, string, size));
+}
+
+InternedString InternPool::Intern(const String& string) {
+  return Intern(string.Data(), string.Size());
+}
+
+size_t InternPool::Size() const {
+  size_t size = 0;
+  for (size_t i = 0; i < kShardCount; ++i) {
+    std::shared_lock lock(shards_[i].mutex);
+    size += shards_[i].count;
+  }
+  return size;
+}
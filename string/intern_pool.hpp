@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "string.hpp"
+
+class InternedString {
+ public:
+  InternedString() = default;
+
+  const char* Data() const;
+
+  size_t Size() const;
+
+  bool Empty() const { return record_ == nullptr; }
+
+  size_t Hash() const;
+
+  String ToString() const;
+
+  bool operator==(const InternedString& other) const {
+    return record_ == other.record_;
+  }
+
+  bool operator!=(const InternedString& other) const {
+    return record_ != other.record_;
+  }
+
+ private:
+  struct Record;
+
+  InternedString(const Record* record) : record_(record){};
+
+  friend class InternPool;
+
+  const Record* record_ = nullptr;
+};
+
+template <>
+struct std::hash<InternedString> {
+  size_t operator()(const InternedString& string) const {
+    return string.Hash();
+  }
+};
+
+class InternPool {
+ public:
+  InternPool();
+
+  InternPool(const InternPool& other) = delete;
+
+  InternPool& operator=(const InternPool& other) = delete;
+
+  InternedString Intern(const char* string, size_t size);
+
+  InternedString Intern(const String& string);
+
+  size_t Size() const;
+
+  ~InternPool();
+
+ private:
+  struct Shard;
+
+  std::unique_ptr<Shard[]> shards_;
+};
+
+std::ostream& operator<<(std::ostream& os, const InternedString& string);
@@ -0,0 +1,204 @@
+#include "rope.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+const size_t kChunkSize = 4096;
+
+uint64_t NextRandom() {
+  thread_local uint64_t state = 0x9E3779B97F4A7C15ULL;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+}  // namespace
+
+struct Rope::Node {
+  std::shared_ptr<const String> text;
+  size_t offset = 0;
+  size_t length = 0;
+  NodePtr left;
+  NodePtr right;
+  size_t size = 0;
+  size_t count = 0;
+};
+
+size_t Rope::SizeOf(const NodePtr& node) { return node ? node->size : 0; }
+
+size_t Rope::CountOf(const NodePtr& node) { return node ? node->count : 0; }
+
+Rope::NodePtr Rope::MakeNode(NodePtr left, std::shared_ptr<const String> text,
+                             size_t offset, size_t length, NodePtr right) {
+  auto node = std::make_shared<Node>();
+  node->size = SizeOf(left) + length + SizeOf(right);
+  node->count = CountOf(left) + 1 + CountOf(right);
+  node->text = std::move(text);
+  node->offset = offset;
+  node->length = length;
+  node->left = std::move(left);
+  node->right = std::move(right);
+  return node;
+}
+
+Rope::NodePtr Rope::Build(const std::shared_ptr<const String>& text,
+                          size_t first_chunk, size_t last_chunk) {
+  if (first_chunk >= last_chunk) {
+    return nullptr;
+  }
+  size_t middle = first_chunk + (last_chunk - first_chunk) / 2;
+  size_t offset = middle * kChunkSize;
+  size_t length = std::min(kChunkSize, text->Size() - offset);
+  return MakeNode(Build(text, first_chunk, middle), text, offset, length,
+                  Build(text, middle + 1, last_chunk));
+}
+
+// Randomized by subtree node count, so shared subtrees stay balanced
+// without storing per-node priorities.
+Rope::NodePtr Rope::Merge(const NodePtr& left, const NodePtr& right) {
+  if (!left) {
+    return right;
+  }
+  if (!right) {
+    return left;
+  }
+  if (NextRandom() % (left->count + right->count) < left->count) {
+    return MakeNode(left->left, left->text, left->offset, left->length,
+                    Merge(left->right, right));
+  }
+  return MakeNode(Merge(left, right->left), right->text, right->offset,
+                  right->length, right->right);
+}
+
+std::pair<Rope::NodePtr, Rope::NodePtr> Rope::Split(const NodePtr& node,
+                                                    size_t pos) {
+  if (pos == 0) {
+    return {nullptr, node};
+  }
+  if (pos >= SizeOf(node)) {
+    return {node, nullptr};
+  }
+  size_t left_size = SizeOf(node->left);
+  if (pos <= left_size) {
+    auto [left, right] = Split(node->left, pos);
+    return {left, MakeNode(right, node->text, node->offset, node->length,
+                           node->right)};
+  }
+  pos -= left_size;
+  if (pos >= node->length) {
+    auto [left, right] = Split(node->right, pos - node->length);
+    return {MakeNode(node->left, node->text, node->offset, node->length, left),
+            right};
+  }
+  return {MakeNode(node->left, node->text, node->offset, pos, nullptr),
+          MakeNode(nullptr, node->text, node->offset + pos, node->length - pos,
+                   node->right)};
+}
+
+Rope::Rope(const String& string) {
+  if (!string.Empty()) {
+    auto text = std::make_shared<const String>(string);
+    root_ = Build(text, 0, (string.Size() + kChunkSize - 1) / kChunkSize);
+  }
+}
+
+Rope::Rope(const char* string) : Rope(String(string)) {}
+
+bool Rope::Empty() const { return root_ == nullptr; }
+
+size_t Rope::Size() const { return SizeOf(root_); }
+
+char Rope::operator[](size_t idx) const {
+  const Node* node = root_.get();
+  while (true) {
+    size_t left_size = SizeOf(node->left);
+    if (idx < left_size) {
+      node = node->left.get();
+    } else if (idx - left_size < node->length) {
+      return node->text->Data()[node->offset + idx - left_size];
+    } else {
+      idx -= left_size + node->length;
+      node = node->right.get();
+    }
+  }
+}
+
+Rope& Rope::operator+=(const Rope& other) {
+  root_ = Merge(root_, other.root_);
+  return *this;
+}
+
+Rope operator+(const Rope& first, const Rope& other) {
+  Rope new_rope(first);
+  new_rope += other;
+  return new_rope;
+}
+
+void Rope::Insert(size_t pos, const Rope& other) {
+  auto [left, right] = Split(root_, pos);
+  root_ = Merge(Merge(left, other.root_), right);
+}
+
+void Rope::Erase(size_t pos, size_t count) {
+  auto [left, rest] = Split(root_, pos);
+  root_ = Merge(left, Split(rest, count).second);
+}
+
+Rope Rope::Substr(size_t pos, size_t count) const {
+  return Rope(Split(Split(root_, pos).second, count).first);
+}
+
+String Rope::Flatten() const {
+  String string;
+  string.Reserve(Size());
+  for (Chunk chunk : *this) {
+    string.Append(chunk.data, chunk.size);
+  }
+  return string;
+}
+
+Rope::ChunkIterator Rope::begin() const { return ChunkIterator(root_.get()); }
+
+Rope::ChunkIterator Rope::end() const { return ChunkIterator(); }
+
+Rope::ChunkIterator::ChunkIterator(const Node* root) { PushLeftPath(root); }
+
+void Rope::ChunkIterator::PushLeftPath(const Node* node) {
+  while (node != nullptr) {
+    path_.push_back(node);
+    node = node->left.get();
+  }
+}
+
+Rope::Chunk Rope::ChunkIterator::operator*() const {
+  const Node* node = path_.back();
+  return {node->text->Data() + node->offset, node->length};
+}
+
+Rope::ChunkIterator& Rope::ChunkIterator::operator++() {
+  const Node* node = path_.back();
+  path_.pop_back();
+  PushLeftPath(node->right.get());
+  return *this;
+}
+
+Rope::ChunkIterator Rope::ChunkIterator::operator++(int) {
+  ChunkIterator copy(*this);
+  ++*this;
+  return copy;
+}
+
+bool Rope::ChunkIterator::operator==(const ChunkIterator& other) const {
+  if (path_.empty() || other.path_.empty()) {
+    return path_.empty() == other.path_.empty();
+  }
+  return path_.back() == other.path_.back();
+}
+
+std::ostream& operator<<(std::ostream& os, const Rope& rope) {
+  for (Rope::Chunk chunk : rope) {
+    os.write(chunk.data, static_cast<std::streamsize>(chunk.size));
+  }
+  return os;
+}
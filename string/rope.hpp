@@ -0,0 +1,94 @@
+#pragma once
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "string.hpp"
+
+class Rope {
+ public:
+  struct Chunk {
+    const char* data = nullptr;
+    size_t size = 0;
+  };
+
+  class ChunkIterator;
+
+  Rope() = default;
+
+  Rope(const String& string);
+
+  Rope(const char* string);
+
+  char operator[](size_t idx) const;
+
+  Rope& operator+=(const Rope& other);
+
+  bool Empty() const;
+
+  size_t Size() const;
+
+  void Insert(size_t pos, const Rope& other);
+
+  void Erase(size_t pos, size_t count);
+
+  Rope Substr(size_t pos, size_t count) const;
+
+  String Flatten() const;
+
+  ChunkIterator begin() const;
+
+  ChunkIterator end() const;
+
+ private:
+  struct Node;
+  using NodePtr = std::shared_ptr<const Node>;
+
+  Rope(NodePtr root) : root_(std::move(root)) {}
+
+  static size_t SizeOf(const NodePtr& node);
+
+  static size_t CountOf(const NodePtr& node);
+
+  static NodePtr MakeNode(NodePtr left, std::shared_ptr<const String> text,
+                          size_t offset, size_t length, NodePtr right);
+
+  static NodePtr Build(const std::shared_ptr<const String>& text,
+                       size_t first_chunk, size_t last_chunk);
+
+  static NodePtr Merge(const NodePtr& left, const NodePtr& right);
+
+  static std::pair<NodePtr, NodePtr> Split(const NodePtr& node, size_t pos);
+
+  NodePtr root_;
+};
+
+class Rope::ChunkIterator {
+ public:
+  using value_type = Chunk;
+  using difference_type = std::ptrdiff_t;
+  using iterator_category = std::forward_iterator_tag;
+
+  ChunkIterator() = default;
+
+  Chunk operator*() const;
+
+  ChunkIterator& operator++();
+
+  ChunkIterator operator++(int);
+
+  bool operator==(const ChunkIterator& other) const;
+
+ private:
+  ChunkIterator(const Node* root);
+
+  void PushLeftPath(const Node* node);
+
+  friend class Rope;
+
+  std::vector<const Node*> path_;
+};
+
+Rope operator+(const Rope& first, const Rope& other);
+
+std::ostream& operator<<(std::ostream& os, const Rope& rope);
@@ -1,27 +1,129 @@
 #include "string.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
 
-String::String(unsigned size, char character)
-    : size_(size), capacity_(size + 1), string_(new char[capacity_]) {
-  std::fill(string_, string_ + size_, character);
+namespace {
+class StreamBufferAccess : public std::streambuf {
+ public:
+  static const char* Current(std::streambuf* buffer) {
+    return (buffer->*&StreamBufferAccess::gptr)();
+  }
+
+  static const char* End(std::streambuf* buffer) {
+    return (buffer->*&StreamBufferAccess::egptr)();
+  }
+
+  static void Consume(std::streambuf* buffer, size_t count) {
+    (buffer->*&StreamBufferAccess::gbump)(static_cast<int>(count));
+  }
+};
+
+bool IsSpace(char character) {
+  return character == ' ' || (character >= '\t' && character <= '\r');
+}
+
+// Feeds whole chunks of the get area to consume until is_stop matches.
+// The stop character is left in the stream buffer.
+template <typename Predicate, typename Consumer>
+bool ScanUntil(std::streambuf* buffer, Predicate is_stop, Consumer consume,
+               bool& eof) {
+  while (buffer->sgetc() != std::char_traits<char>::eof()) {
+    const char* begin = StreamBufferAccess::Current(buffer);
+    const char* end = StreamBufferAccess::End(buffer);
+    if (begin == end) {
+      // Unbuffered stream
+      char character = std::char_traits<char>::to_char_type(buffer->sgetc());
+      if (is_stop(character)) {
+        return true;
+      }
+      consume(&character, 1);
+      buffer->sbumpc();
+      continue;
+    }
+    const char* stop = begin;
+    while (stop != end && !is_stop(*stop)) {
+      ++stop;
+    }
+    consume(begin, stop - begin);
+    StreamBufferAccess::Consume(buffer, stop - begin);
+    if (stop != end) {
+      return true;
+    }
+  }
+  eof = true;
+  return false;
+}
+
+// Repeats the first filled characters of buffer until size characters are
+// set, doubling the copied block on every step.
+void RepeatPrefix(char* buffer, size_t filled, size_t size) {
+  while (filled < size) {
+    size_t count = std::min(filled, size - filled);
+    std::memcpy(buffer + filled, buffer, count);
+    filled += count;
+  }
+}
+
+void AppendChunk(String& string, const char* chunk, size_t size) {
+  if (string.Capacity() < string.Size() + size) {
+    string.Reserve(std::max(string.Size() + size, string.Capacity() * 2));
+  }
+  string.Append(chunk, size);
+}
+}  // namespace
+
+String::String(std::pmr::memory_resource* resource) : resource_(resource) {}
+
+String::String(unsigned size, char character,
+               std::pmr::memory_resource* resource)
+    : resource_(resource),
+      size_(size),
+      capacity_(size + 1),
+      string_(Allocate(capacity_)) {
+  std::memset(string_, character, size_);
   string_[size_] = '\0';
 }
 
-String::String(const char* string, int size, int capacity)
-    : size_(size),
+String::String(const char* string, int size, int capacity,
+               std::pmr::memory_resource* resource)
+    : resource_(resource),
+      size_(size),
       capacity_(capacity > 0 && capacity != size ? capacity : capacity + 1),
-      string_(new char[capacity_]) {
+      string_(Allocate(capacity_)) {
   std::copy(string, string + size_, string_);
   string_[size_] = '\0';
 }
 
-String::String(const char* string)
-    : String(string, std::strlen(string), std::strlen(string) + 1) {}
+String::String(const char* string, std::pmr::memory_resource* resource)
+    : String(string, std::strlen(string), std::strlen(string) + 1, resource) {}
 
 String::String(const String& string)
     : String(string.string_, string.size_, string.capacity_) {}
 
+String::String(const String& string, std::pmr::memory_resource* resource)
+    : String(string.string_, string.size_, string.capacity_, resource) {}
+
+std::pmr::memory_resource* String::GetResource() const { return resource_; }
+
+char* String::Allocate(size_t capacity) {
+  if (resource_ != nullptr) {
+    return static_cast<char*>(resource_->allocate(capacity, 1));
+  }
+  return new char[capacity];
+}
+
+void String::Deallocate(char* string, size_t capacity) {
+  if (resource_ != nullptr) {
+    if (string != nullptr) {
+      resource_->deallocate(string, capacity, 1);
+    }
+    return;
+  }
+  delete[] string;
+}
+
 bool String::Empty() const { return size_ == 0; }
 
 size_t String::Size() const { return size_; }
@@ -44,21 +146,22 @@ String& String::operator=(const String& other) {
   if (this == &other) {
     return *this;
   }
-  String temp = other;
+  String temp(other, resource_);
   Swap(temp);
   return *this;
 }
 
 void String::ChangeCapacity(size_t new_capacity) {
-  char* new_string = new char[new_capacity];
+  char* new_string = Allocate(new_capacity);
   if (new_capacity < size_) {
     std::copy(string_, string_ + new_capacity, new_string);
   } else if (string_ != nullptr) {
     std::copy(string_, string_ + size_, new_string);
   }
+  Deallocate(string_, capacity_);
   capacity_ = new_capacity;
-  size_ = size_ <= capacity_ ? size_ : capacity_;
-  delete[] string_;
+  size_ = size_ < capacity_ ? size_ : capacity_ - 1;
+  new_string[size_] = '\0';
   string_ = new_string;
 }
 
@@ -106,21 +209,35 @@ void String::ShrinkToFit() {
 }
 
 void String::Swap(String& other) {
+  std::swap(resource_, other.resource_);
   std::swap(string_, other.string_);
   std::swap(size_, other.size_);
   std::swap(capacity_, other.capacity_);
 }
 
-String& String::operator+=(const String& other) {
-  if (capacity_ < size_ + other.size_ + 1) {
-    ChangeCapacity(size_ + other.size_ + 1);
+String& String::Append(const char* string, size_t size) {
+  if (capacity_ < size_ + size + 1) {
+    // Pointers into different arrays may only be compared through the
+    // std:: comparison objects.
+    bool inside = string_ != nullptr &&
+                  std::greater_equal<const char*>()(string, string_) &&
+                  std::less<const char*>()(string, string_ + capacity_);
+    size_t offset = inside ? string - string_ : 0;
+    ChangeCapacity(size_ + size + 1);
+    if (inside) {
+      string = string_ + offset;
+    }
   }
-  std::copy(other.string_, other.string_ + other.size_, (string_ + size_));
-  size_ += other.size_;
+  std::copy(string, string + size, string_ + size_);
+  size_ += size;
   string_[size_] = '\0';
   return *this;
 }
 
+String& String::operator+=(const String& other) {
+  return Append(other.string_, other.size_);
+}
+
 String operator+(const String& first, const String& other) {
   String new_string(first);
   new_string += other;
@@ -128,11 +245,16 @@ String operator+(const String& first, const String& other) {
 }
 
 String& String::operator*=(int number) {
-  ChangeCapacity(size_ * number + 1);
-  for (unsigned i = 0; i < size_ * number; ++i) {
-    string_[i] = string_[i % size_];
+  if (number <= 0 || size_ == 0) {
+    Clear();
+    return *this;
   }
-  size_ *= number;
+  size_t new_size = size_ * number;
+  if (capacity_ < new_size + 1) {
+    ChangeCapacity(new_size + 1);
+  }
+  RepeatPrefix(string_, size_, new_size);
+  size_ = new_size;
   string_[size_] = '\0';
   return *this;
 }
@@ -149,15 +271,56 @@ std::ostream& operator<<(std::ostream& os, const String& string) {
 }
 
 std::istream& operator>>(std::istream& is, String& string) {
-  char symbol;
-  while (is.get(symbol)) {
-    if ((std::isspace(symbol) != 0 || symbol == '\n')) {
-      if (!string.Empty()) {
-        break;
-      }
-    } else {
-      string.PushBack(symbol);
-    }
+  std::istream::sentry sentry(is, true);
+  if (!sentry) {
+    return is;
+  }
+  std::streambuf* buffer = is.rdbuf();
+  bool eof = false;
+  if (string.Empty()) {
+    ScanUntil(
+        buffer, [](char character) { return !IsSpace(character); },
+        [](const char*, size_t) {}, eof);
+  }
+  size_t old_size = string.Size();
+  if (!eof && ScanUntil(
+                  buffer, IsSpace,
+                  [&string](const char* chunk, size_t size) {
+                    AppendChunk(string, chunk, size);
+                  },
+                  eof)) {
+    buffer->sbumpc();
+  }
+  if (eof) {
+    is.setstate(std::ios_base::eofbit);
+  }
+  if (string.Size() == old_size) {
+    is.setstate(std::ios_base::failbit);
+  }
+  return is;
+}
+
+std::istream& GetLine(std::istream& is, String& string, char delim) {
+  std::istream::sentry sentry(is, true);
+  if (!sentry) {
+    return is;
+  }
+  string.Clear();
+  bool eof = false;
+  bool found = ScanUntil(
+      is.rdbuf(), [delim](char character) { return character == delim; },
+      [&string](const char* chunk, size_t size) {
+        AppendChunk(string, chunk, size);
+      },
+      eof);
+  if (found) {
+    is.rdbuf()->sbumpc();
+  }
+  if (eof) {
+    is.setstate(std::ios_base::eofbit);
+  }
+  if (!found && string.Empty()) {
+    is.setstate(std::ios_base::failbit);
   }
   return is;
 }
@@ -169,7 +332,7 @@ void String::Clear() {
   }
 }
 
-String::~String() { delete[] string_; }
+String::~String() { Deallocate(string_, capacity_); }
 
 char& String::operator[](int idx) { return string_[idx]; }
 
@@ -1,17 +1,23 @@
 #pragma once
 #include <iostream>
+#include <memory_resource>
 #include <vector>
 
 class String {
  public:
   String() = default;
 
-  String(unsigned size, char character);
+  explicit String(std::pmr::memory_resource* resource);
 
-  String(const char* string);
+  String(unsigned size, char character,
+         std::pmr::memory_resource* resource = nullptr);
+
+  String(const char* string, std::pmr::memory_resource* resource = nullptr);
 
   String(const String& string);
 
+  String(const String& string, std::pmr::memory_resource* resource);
+
   String& operator=(const String& other);
 
   char& operator[](int idx);
@@ -20,6 +26,8 @@ class String {
 
   String& operator+=(const String& other);
 
+  String& Append(const char* string, size_t size);
+
   String operator*(int number) const;
   String& operator*=(int number);
 
@@ -37,6 +45,8 @@ class String {
 
   size_t Capacity() const;
 
+  std::pmr::memory_resource* GetResource() const;
+
   char* Data();
 
   const char* Data() const;
@@ -66,10 +76,16 @@ class String {
   ~String();
 
  private:
-  String(const char* string, int size, int capacity);
+  String(const char* string, int size, int capacity,
+         std::pmr::memory_resource* resource = nullptr);
+
+  char* Allocate(size_t capacity);
+
+  void Deallocate(char* string, size_t capacity);
 
   void ChangeCapacity(size_t new_capacity);
 
+  std::pmr::memory_resource* resource_ = nullptr;
   size_t size_ = 0;
   size_t capacity_ = 0;
   char* string_ = nullptr;
@@ -91,4 +107,6 @@ std::ostream& operator<<(std::ostream& os, const String& string);
 
 std::istream& operator>>(std::istream& is, String& string);
 
+std::istream& GetLine(std::istream& is, String& string, char delim = '\n');
+
 String operator+(const String& first, const String& other);
\ No newline at end of file